@@ -0,0 +1,60 @@
+#include "batch.hpp"
+
+#include <format>
+#include <stdexcept>
+#include <type_traits>
+
+ColumnData make_column_data(const ColumnSchema& column) {
+    switch (column.netcdf_type) {
+        case NC_DOUBLE:
+            return std::vector<double>{};
+        case NC_UINT64:
+            return std::vector<uint64_t>{};
+        case NC_INT:
+            return std::vector<int32_t>{};
+        case NC_BYTE:
+            return std::vector<int8_t>{};
+        case NC_SHORT:
+        case NC_USHORT:
+            return std::vector<int16_t>{};
+        default:
+            throw std::runtime_error(std::format("unsupported NetCDF type {} for column {}", column.netcdf_type, column.label));
+    }
+}
+
+Batch::Batch(const CaptureSchema2& schema) {
+    columns.reserve(schema.columns.size());
+    for (const ColumnSchema& column : schema.columns) {
+        columns.push_back(make_column_data(column));
+    }
+}
+
+void Batch::clear() {
+    rows = 0;
+    for (auto& column : columns) {
+        std::visit([](auto& values) { values.clear(); }, column);
+    }
+}
+
+void Batch::reserve(size_t rows) {
+    for (auto& column : columns) {
+        std::visit([rows](auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            // int16 columns hold the two dimensional samples block
+            values.reserve(std::is_same_v<T, int16_t> ? rows * samples_per_row : rows);
+        }, column);
+    }
+}
+
+BatchView Batch::view() const {
+    BatchView view;
+    view.rows = rows;
+    view.columns.reserve(columns.size());
+    for (const auto& column : columns) {
+        std::visit([&view](const auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            view.columns.push_back(std::span<const T>(values));
+        }, column);
+    }
+    return view;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <variant>
+#include <vector>
+
+#include "parsing.hpp"
+
+// Typed storage for one column of a batch. The samples column is stored row
+// major with samples_per_row values per row.
+using ColumnData = std::variant<
+    std::vector<double>,
+    std::vector<uint64_t>,
+    std::vector<int32_t>,
+    std::vector<int8_t>,
+    std::vector<int16_t>
+>;
+
+// Read-only counterpart of ColumnData, pointing into a Batch or a mapped file.
+using ColumnView = std::variant<
+    std::span<const double>,
+    std::span<const uint64_t>,
+    std::span<const int32_t>,
+    std::span<const int8_t>,
+    std::span<const int16_t>
+>;
+
+ColumnData make_column_data(const ColumnSchema& column);
+
+// Rows in columnar form without owning them. The Writer consumes views, so
+// rows can come from a Batch or straight from a ColumnCache mapping.
+struct BatchView {
+    template<typename T>
+    std::span<const T> column(size_t index) const {
+        return std::get<std::span<const T>>(columns[index]);
+    }
+
+    size_t rows = 0;
+    std::vector<ColumnView> columns;
+};
+
+// A block of rows in columnar form, laid out in the schema's column order.
+// This is what the CsvReader produces and what the Writer consumes, so callers
+// holding binary samples can skip the CSV text entirely.
+class Batch {
+public:
+    explicit Batch(const CaptureSchema2& schema);
+
+    void clear();
+    void reserve(size_t rows);
+
+    BatchView view() const;
+
+    template<typename T>
+    std::vector<T>& column(size_t index) {
+        return std::get<std::vector<T>>(columns[index]);
+    }
+
+    template<typename T>
+    const std::vector<T>& column(size_t index) const {
+        return std::get<std::vector<T>>(columns[index]);
+    }
+
+    size_t rows = 0;
+    std::vector<ColumnData> columns;
+};
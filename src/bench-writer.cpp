@@ -0,0 +1,144 @@
+#include "CLI/CLI.hpp"
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "csv_reader.hpp"
+#include "parsing.hpp"
+#include "writer.hpp"
+
+// Compares handing binary batches straight to the Writer against the CSV
+// round trip (CsvReader -> Writer) for the same synthetic v3 rows.
+
+namespace fs = std::filesystem;
+
+static void fill_row(Batch& batch, size_t row, std::mt19937& rng) {
+    std::uniform_int_distribution<int> sample(0, 1023);
+
+    batch.column<double>(0).push_back(static_cast<double>(row));
+    batch.column<uint64_t>(1).push_back(1'000'000'000 + row);
+    batch.column<int8_t>(2).push_back(1);
+    batch.column<int8_t>(3).push_back(0);
+    batch.column<double>(4).push_back(7200.0);
+    batch.column<double>(5).push_back(64.8);
+    batch.column<double>(6).push_back(-147.7);
+    batch.column<double>(7).push_back(130.0);
+    batch.column<int32_t>(8).push_back(9);
+    batch.column<double>(9).push_back(0.0);
+    batch.column<double>(10).push_back(0.0);
+    batch.column<int32_t>(11).push_back(static_cast<int32_t>(samples_per_row));
+
+    auto& samples = batch.column<int16_t>(12);
+    for (size_t i = 0; i < samples_per_row; i++) {
+        samples.push_back(static_cast<int16_t>(sample(rng)));
+    }
+
+    batch.rows++;
+}
+
+static void write_csv_row(std::ofstream& out, const Batch& batch, size_t row) {
+    out << batch.column<double>(0)[row] << ',' << batch.column<uint64_t>(1)[row] << ",G,"
+        << batch.column<double>(4)[row] << ',' << batch.column<double>(5)[row] << ','
+        << batch.column<double>(6)[row] << ',' << batch.column<double>(7)[row] << ','
+        << batch.column<int32_t>(8)[row] << ',' << batch.column<double>(9)[row] << ','
+        << batch.column<double>(10)[row] << ',' << samples_per_row;
+
+    const int16_t* samples = batch.column<int16_t>(12).data() + row * samples_per_row;
+    long checksum = 0;
+    for (size_t i = 0; i < samples_per_row; i++) {
+        out << ',' << samples[i];
+        checksum += samples[i];
+    }
+    out << ',' << checksum << '\n';
+}
+
+int main(int argc, char **argv) {
+    CLI::App app{"Benchmark the in-memory Writer path against the CSV path"};
+
+    size_t rows = 3600;
+    app.add_option("--rows,-n", rows, "Rows to write per run")
+        ->default_val(3600);
+
+    size_t batch_rows = 64;
+    app.add_option("--batch-rows", batch_rows, "Rows per batch")
+        ->default_val(64);
+
+    std::string work_dir = fs::temp_directory_path().string();
+    app.add_option("--work-dir", work_dir, "Directory for scratch files");
+
+    CLI11_PARSE(app, argc, argv);
+
+    spdlog::set_pattern("[%^%l%$] %v");
+
+    const CaptureSchema2& schema = v3_schema;
+    fs::path csv_path = fs::path(work_dir) / "csv2nc-bench.csv";
+    fs::path memory_output = fs::path(work_dir) / "csv2nc-bench-memory.nc";
+    fs::path csv_output = fs::path(work_dir) / "csv2nc-bench-csv.nc";
+
+    std::mt19937 rng(42);
+    std::vector<Batch> batches;
+    for (size_t row = 0; row < rows; row += batch_rows) {
+        Batch batch(schema);
+        batch.reserve(batch_rows);
+        for (size_t i = row; i < std::min(rows, row + batch_rows); i++) {
+            fill_row(batch, i, rng);
+        }
+        batches.push_back(std::move(batch));
+    }
+
+    {
+        std::ofstream out(csv_path);
+        out << "## BEGIN METADATA ##\n# VERSION 3\n## END METADATA ##\n";
+        for (const Batch& batch : batches) {
+            for (size_t row = 0; row < batch.rows; row++) {
+                write_csv_row(out, batch, row);
+            }
+        }
+    }
+
+    WriterOptions options;
+    options.schema_version = 3;
+
+    using clock = std::chrono::steady_clock;
+
+    auto start = clock::now();
+    {
+        Writer writer(memory_output, schema, options);
+        for (const Batch& batch : batches) {
+            writer.append(batch);
+        }
+        writer.close();
+    }
+    std::chrono::duration<double> memory_seconds = clock::now() - start;
+
+    start = clock::now();
+    {
+        Writer writer(csv_output, schema, options);
+        CsvReader reader({csv_path}, schema, 3);
+        Batch batch(schema);
+        batch.reserve(batch_rows);
+        while (reader.next(batch, batch_rows)) {
+            writer.append(batch);
+        }
+        writer.set_parsing_errors(reader.errors());
+        writer.close();
+    }
+    std::chrono::duration<double> csv_seconds = clock::now() - start;
+
+    double csv_mb = static_cast<double>(fs::file_size(csv_path)) / (1 << 20);
+    spdlog::info("in-memory: {} rows in {:.3f}s ({:.0f} rows/s)", rows, memory_seconds.count(), rows / memory_seconds.count());
+    spdlog::info("csv:       {} rows in {:.3f}s ({:.0f} rows/s, {:.1f} MiB/s of text)", rows, csv_seconds.count(), rows / csv_seconds.count(), csv_mb / csv_seconds.count());
+    spdlog::info("speedup:   {:.1f}x", csv_seconds.count() / memory_seconds.count());
+
+    fs::remove(csv_path);
+    fs::remove(memory_output);
+    fs::remove(csv_output);
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "cached_reader.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+CachedReader::CachedReader(std::vector<fs::path> files, std::vector<uint64_t> file_hashes,
+                           const CaptureSchema2& schema, int schema_version, const fs::path& cache_directory,
+                           const ReadAheadOptions& read_options, bool verify_checksum)
+    : files_(std::move(files)), file_hashes_(std::move(file_hashes)), schema_(schema),
+      schema_version_(schema_version), cache_directory_(cache_directory), read_options_(read_options),
+      verify_checksum_(verify_checksum),
+      // The cache only holds the rows the checksum setting lets through
+      checksum_verified_(make_line_decoder(schema_version, schema, verify_checksum).verify_checksum),
+      batch_(schema) {
+
+    if (file_hashes_.size() != files_.size()) {
+        throw std::runtime_error("CachedReader needs one content hash per input");
+    }
+}
+
+void CachedReader::open_next() {
+    const fs::path& file = files_[file_index_];
+    const fs::path cache_path = column_cache_path(file, cache_directory_);
+
+    cache_ = open_column_cache(cache_path, schema_, schema_version_, file_hashes_[file_index_], checksum_verified_);
+    if (cache_) {
+        spdlog::info("reading {} from {}", file.string(), cache_path.string());
+        row_group_ = 0;
+        return;
+    }
+
+    try {
+        cache_writer_ = std::make_unique<ColumnCacheWriter>(cache_path, schema_, schema_version_,
+                                                            file_hashes_[file_index_], checksum_verified_);
+    } catch (const std::exception& e) {
+        spdlog::warn("{}, converting without a cache", e.what());
+    }
+
+    reader_ = std::make_unique<CsvReader>(std::vector<fs::path>{file}, schema_, schema_version_, read_options_,
+                                          verify_checksum_);
+}
+
+void CachedReader::finish_file() {
+    if (cache_) {
+        lines_done_ += cache_->lines();
+        errors_done_ += cache_->errors();
+        cache_.reset();
+    }
+
+    if (reader_) {
+        if (cache_writer_) {
+            try {
+                cache_writer_->finish(reader_->lines(), reader_->errors());
+            } catch (const std::exception& e) {
+                spdlog::warn("{}, dropping the cache", e.what());
+            }
+            cache_writer_.reset();
+        }
+
+        lines_done_ += reader_->lines();
+        errors_done_ += reader_->errors();
+        reader_.reset();
+    }
+
+    file_index_++;
+}
+
+bool CachedReader::next(BatchView& rows, size_t max_rows) {
+    for (;;) {
+        if (cache_) {
+            if (row_group_ < cache_->row_groups()) {
+                rows = cache_->row_group(row_group_++);
+                return true;
+            }
+            finish_file();
+            continue;
+        }
+
+        if (reader_) {
+            if (reader_->next(batch_, max_rows)) {
+                if (cache_writer_) {
+                    try {
+                        cache_writer_->append(batch_);
+                    } catch (const std::exception& e) {
+                        spdlog::warn("{}, dropping the cache", e.what());
+                        cache_writer_.reset();
+                    }
+                }
+                rows = batch_.view();
+                return true;
+            }
+            finish_file();
+            continue;
+        }
+
+        if (file_index_ >= files_.size()) {
+            return false;
+        }
+        open_next();
+    }
+}
+
+uint64_t CachedReader::errors() const {
+    if (cache_) {
+        return errors_done_ + cache_->errors();
+    }
+    return errors_done_ + (reader_ ? reader_->errors() : 0);
+}
+
+size_t CachedReader::lines() const {
+    if (cache_) {
+        return lines_done_ + cache_->lines() * row_group_ / std::max<size_t>(cache_->row_groups(), 1);
+    }
+    return lines_done_ + (reader_ ? reader_->lines() : 0);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "batch.hpp"
+#include "column_cache.hpp"
+#include "csv_reader.hpp"
+#include "parsing.hpp"
+#include "read_ahead.hpp"
+
+// Reads capture CSV files like CsvReader, but through a column cache per
+// input. An input with a usable cache is served straight from its mapping,
+// any other is parsed and its cache written on the way. A cache that cannot be
+// written is dropped with a warning and the input is still read. Inputs are
+// read one at a time, as caches are per input.
+class CachedReader {
+public:
+    // file_hashes holds the XXH64 of each input, as scan_input computes it.
+    // Caches go next to the inputs unless cache_directory is given.
+    CachedReader(std::vector<std::filesystem::path> files, std::vector<uint64_t> file_hashes,
+                 const CaptureSchema2& schema, int schema_version,
+                 const std::filesystem::path& cache_directory,
+                 const ReadAheadOptions& read_options = {}, bool verify_checksum = true);
+
+    CachedReader(const CachedReader&) = delete;
+    CachedReader& operator=(const CachedReader&) = delete;
+
+    // Points rows at the next rows: up to max_rows parsed rows, or one whole
+    // row group of a cache. The view stays valid until the next call. Returns
+    // false once every file has been consumed.
+    bool next(BatchView& rows, size_t max_rows);
+
+    uint64_t errors() const;
+
+    size_t lines() const;
+
+    size_t file_index() const {
+        return file_index_;
+    }
+
+private:
+    void open_next();
+    void finish_file();
+
+    std::vector<std::filesystem::path> files_;
+    std::vector<uint64_t> file_hashes_;
+    CaptureSchema2 schema_;
+    int schema_version_;
+    std::filesystem::path cache_directory_;
+    ReadAheadOptions read_options_;
+    bool verify_checksum_;
+    bool checksum_verified_;
+
+    Batch batch_;
+    std::unique_ptr<ColumnCache> cache_;
+    size_t row_group_ = 0;
+    std::unique_ptr<CsvReader> reader_;
+    std::unique_ptr<ColumnCacheWriter> cache_writer_;
+
+    size_t file_index_ = 0;
+    // Lines and errors of the inputs already finished
+    size_t lines_done_ = 0;
+    uint64_t errors_done_ = 0;
+};
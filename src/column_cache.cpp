@@ -0,0 +1,280 @@
+#include "column_cache.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+static constexpr char cache_magic[8] = {'C', '2', 'N', 'C', 'C', 'O', 'L', 'S'};
+static constexpr uint32_t cache_byte_order = 0x01020304;
+static constexpr uint32_t cache_flag_checksum_verified = 1;
+static constexpr uint64_t cache_alignment = 64;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t schema_version;
+    uint32_t flags;
+    uint64_t source_hash;
+    uint32_t column_count;
+    uint32_t parser_revision;
+};
+
+struct CacheColumn {
+    uint32_t netcdf_type;
+    uint32_t label_length;
+};
+
+struct CacheTrailer {
+    uint64_t rows;
+    uint64_t lines;
+    uint64_t errors;
+    uint64_t row_groups;
+    uint64_t footer_offset;
+    char magic[8];
+};
+
+fs::path column_cache_path(const fs::path& input_path, const fs::path& cache_directory) {
+    fs::path name = input_path.filename();
+    name += ".c2nc";
+    return cache_directory.empty() ? input_path.parent_path() / name : cache_directory / name;
+}
+
+ColumnCacheWriter::ColumnCacheWriter(const fs::path& path, const CaptureSchema2& schema, int schema_version,
+                                     uint64_t source_hash, bool checksum_verified)
+    : path_(path), temp_path_(path.string() + ".tmp"), column_count_(schema.columns.size()) {
+
+    out_.open(temp_path_, std::ios::binary | std::ios::trunc);
+    if (!out_) {
+        throw std::runtime_error(std::format("failed to create column cache {}: {}", temp_path_.string(), std::strerror(errno)));
+    }
+
+    CacheHeader header{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = column_cache_version;
+    header.byte_order = cache_byte_order;
+    header.schema_version = static_cast<uint32_t>(schema_version);
+    header.flags = checksum_verified ? cache_flag_checksum_verified : 0;
+    header.source_hash = source_hash;
+    header.column_count = static_cast<uint32_t>(column_count_);
+    header.parser_revision = line_parser_revision;
+    write(&header, sizeof(header));
+
+    for (const ColumnSchema& column : schema.columns) {
+        CacheColumn entry{column.netcdf_type, static_cast<uint32_t>(column.label.size())};
+        write(&entry, sizeof(entry));
+        write(column.label.data(), column.label.size());
+    }
+}
+
+ColumnCacheWriter::~ColumnCacheWriter() {
+    if (!finished_) {
+        out_.close();
+        std::error_code ec;
+        fs::remove(temp_path_, ec);
+    }
+}
+
+void ColumnCacheWriter::write(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    if (!out_) {
+        throw std::runtime_error(std::format("failed to write column cache {}", temp_path_.string()));
+    }
+    offset_ += size;
+}
+
+void ColumnCacheWriter::align() {
+    static constexpr char padding[cache_alignment] = {};
+    write(padding, (cache_alignment - offset_ % cache_alignment) % cache_alignment);
+}
+
+void ColumnCacheWriter::append(const Batch& batch) {
+    if (batch.columns.size() != column_count_) {
+        throw std::runtime_error(std::format("batch has {} columns, column cache has {}", batch.columns.size(), column_count_));
+    }
+
+    if (batch.rows == 0) {
+        return;
+    }
+
+    footer_.push_back(batch.rows);
+    for (const auto& column : batch.columns) {
+        std::visit([this](const auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            align();
+            footer_.push_back(offset_);
+            write(values.data(), values.size() * sizeof(T));
+        }, column);
+    }
+    rows_ += batch.rows;
+}
+
+void ColumnCacheWriter::finish(uint64_t lines, uint64_t errors) {
+    align();
+
+    CacheTrailer trailer{};
+    trailer.rows = rows_;
+    trailer.lines = lines;
+    trailer.errors = errors;
+    trailer.row_groups = footer_.size() / (column_count_ + 1);
+    trailer.footer_offset = offset_;
+    std::memcpy(trailer.magic, cache_magic, sizeof(cache_magic));
+
+    write(footer_.data(), footer_.size() * sizeof(uint64_t));
+    write(&trailer, sizeof(trailer));
+
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error(std::format("failed to close column cache {}", temp_path_.string()));
+    }
+
+    fs::rename(temp_path_, path_);
+    finished_ = true;
+    spdlog::debug("wrote column cache {} with {} rows in {} row groups", path_.string(), rows_, trailer.row_groups);
+}
+
+std::unique_ptr<ColumnCache> open_column_cache(const fs::path& path, const CaptureSchema2& schema,
+                                               int schema_version, uint64_t source_hash, bool checksum_verified) {
+    if (!fs::exists(path)) {
+        return nullptr;
+    }
+
+    auto unusable = [&path](const std::string& reason) -> std::unique_ptr<ColumnCache> {
+        spdlog::debug("not using column cache {}: {}", path.string(), reason);
+        return nullptr;
+    };
+
+    std::unique_ptr<ColumnCache> cache;
+    try {
+        cache.reset(new ColumnCache(path));
+    } catch (const std::exception& e) {
+        spdlog::warn("{}", e.what());
+        return nullptr;
+    }
+
+    std::string_view data = cache->file_.view();
+    if (data.size() < sizeof(CacheHeader) + sizeof(CacheTrailer)) {
+        return unusable("file is truncated");
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.byte_order != cache_byte_order) {
+        return unusable("not a column cache for this machine");
+    }
+    if (header.version != column_cache_version) {
+        return unusable(std::format("format version {} != {}", header.version, column_cache_version));
+    }
+    if (header.parser_revision != line_parser_revision) {
+        return unusable(std::format("parser revision {} != {}", header.parser_revision, line_parser_revision));
+    }
+    if (header.schema_version != static_cast<uint32_t>(schema_version)) {
+        return unusable(std::format("schema version {} != {}", header.schema_version, schema_version));
+    }
+    if (header.source_hash != source_hash) {
+        return unusable("input has changed");
+    }
+    if (((header.flags & cache_flag_checksum_verified) != 0) != checksum_verified) {
+        return unusable("checksum verification differs");
+    }
+
+    CacheTrailer trailer;
+    std::memcpy(&trailer, data.data() + data.size() - sizeof(trailer), sizeof(trailer));
+    if (std::memcmp(trailer.magic, cache_magic, sizeof(cache_magic)) != 0) {
+        return unusable("file is incomplete");
+    }
+
+    const uint64_t group_entries = uint64_t{header.column_count} + 1;
+    if (trailer.footer_offset > data.size() - sizeof(trailer) ||
+        (data.size() - trailer.footer_offset - sizeof(trailer)) / sizeof(uint64_t) / group_entries != trailer.row_groups ||
+        (data.size() - trailer.footer_offset - sizeof(trailer)) % (group_entries * sizeof(uint64_t)) != 0) {
+        return unusable("footer is damaged");
+    }
+
+    // Column table, matched by label against the requested schema
+    std::vector<std::pair<std::string, uint32_t>> cached_columns;
+    size_t position = sizeof(CacheHeader);
+    for (uint32_t i = 0; i < header.column_count; i++) {
+        CacheColumn entry;
+        if (position + sizeof(entry) > trailer.footer_offset) {
+            return unusable("column table is damaged");
+        }
+        std::memcpy(&entry, data.data() + position, sizeof(entry));
+        position += sizeof(entry);
+
+        if (position + entry.label_length > trailer.footer_offset) {
+            return unusable("column table is damaged");
+        }
+        cached_columns.emplace_back(std::string(data.substr(position, entry.label_length)), entry.netcdf_type);
+        position += entry.label_length;
+    }
+
+    // Which rows were dropped depends on which fields were parsed, so only a
+    // cache of exactly the projected columns holds the rows a fresh parse would
+    if (cached_columns.size() != schema.columns.size()) {
+        return unusable(std::format("cache holds {} columns, conversion needs {}", cached_columns.size(), schema.columns.size()));
+    }
+
+    std::vector<size_t> column_map;
+    for (const ColumnSchema& column : schema.columns) {
+        size_t index = 0;
+        while (index < cached_columns.size() && cached_columns[index].first != column.label) {
+            index++;
+        }
+        if (index == cached_columns.size()) {
+            return unusable(std::format("column {} is missing", column.label));
+        }
+        if (cached_columns[index].second != column.netcdf_type) {
+            return unusable(std::format("column {} has a different type", column.label));
+        }
+        column_map.push_back(index);
+    }
+
+    std::vector<uint64_t> footer(trailer.row_groups * group_entries);
+    std::memcpy(footer.data(), data.data() + trailer.footer_offset, footer.size() * sizeof(uint64_t));
+
+    uint64_t rows = 0;
+    for (uint64_t group = 0; group < trailer.row_groups; group++) {
+        const uint64_t* entry = footer.data() + group * group_entries;
+
+        BatchView view;
+        view.rows = entry[0];
+        for (size_t i = 0; i < schema.columns.size(); i++) {
+            const uint64_t offset = entry[1 + column_map[i]];
+            bool valid = true;
+
+            std::visit([&](const auto& values) {
+                using T = typename std::decay_t<decltype(values)>::value_type;
+                const uint64_t count = std::is_same_v<T, int16_t> ? view.rows * samples_per_row : view.rows;
+                if (offset % alignof(T) != 0 || offset > trailer.footer_offset ||
+                    count > (trailer.footer_offset - offset) / sizeof(T)) {
+                    valid = false;
+                    return;
+                }
+                view.columns.push_back(std::span<const T>(reinterpret_cast<const T*>(data.data() + offset), count));
+            }, make_column_data(schema.columns[i]));
+
+            if (!valid) {
+                return unusable(std::format("row group {} is damaged", group));
+            }
+        }
+
+        rows += view.rows;
+        cache->row_groups_.push_back(std::move(view));
+    }
+
+    if (rows != trailer.rows) {
+        return unusable("row counts do not add up");
+    }
+
+    cache->rows_ = trailer.rows;
+    cache->lines_ = trailer.lines;
+    cache->errors_ = trailer.errors;
+    spdlog::debug("using column cache {} with {} rows", path.string(), cache->rows_);
+    return cache;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "parsing.hpp"
+#include "utils.hpp"
+
+// Parsed rows of one input file in a memory-mappable columnar form, so that
+// re-encoding the same capture with other NetCDF settings skips the CSV
+// parser. Layout, all integers in host byte order:
+//
+//   header     magic, format version, byte order mark, schema version,
+//              flags, XXH64 of the input, column count, line parser revision,
+//              then per column its NetCDF type and label
+//   row groups one per written batch; each column is a typed array in schema
+//              order, samples row major, every array 64 byte aligned
+//   footer     per row group its row count and array offsets
+//   trailer    total rows, input lines, parsing errors, row group count,
+//              footer offset and the magic again
+//
+// The trailer is written last and the file is only renamed into place once it
+// is complete, so a cache cut short by a crash is never picked up.
+
+constexpr uint32_t column_cache_version = 1;
+
+// The cache file for an input, next to it or in cache_directory if given.
+std::filesystem::path column_cache_path(const std::filesystem::path& input_path,
+                                        const std::filesystem::path& cache_directory);
+
+class ColumnCacheWriter {
+public:
+    // checksum_verified records whether rows with bad checksums were dropped,
+    // which decides which rows the cache holds.
+    ColumnCacheWriter(const std::filesystem::path& path, const CaptureSchema2& schema, int schema_version,
+                      uint64_t source_hash, bool checksum_verified);
+    ~ColumnCacheWriter();
+
+    ColumnCacheWriter(const ColumnCacheWriter&) = delete;
+    ColumnCacheWriter& operator=(const ColumnCacheWriter&) = delete;
+
+    // Stores the batch as one row group.
+    void append(const Batch& batch);
+
+    // Writes the footer and moves the cache into place.
+    void finish(uint64_t lines, uint64_t errors);
+
+private:
+    void write(const void* data, size_t size);
+    void align();
+
+    std::filesystem::path path_;
+    std::filesystem::path temp_path_;
+    std::ofstream out_;
+    size_t column_count_;
+    uint64_t offset_ = 0;
+    uint64_t rows_ = 0;
+    std::vector<uint64_t> footer_;
+    bool finished_ = false;
+};
+
+// A mapped cache file. Row groups come back as views into the mapping, holding
+// the columns of the schema it was opened with, in that schema's order.
+class ColumnCache {
+public:
+    size_t row_groups() const {
+        return row_groups_.size();
+    }
+
+    BatchView row_group(size_t index) const {
+        return row_groups_[index];
+    }
+
+    uint64_t rows() const {
+        return rows_;
+    }
+
+    uint64_t lines() const {
+        return lines_;
+    }
+
+    uint64_t errors() const {
+        return errors_;
+    }
+
+private:
+    friend std::unique_ptr<ColumnCache> open_column_cache(const std::filesystem::path&, const CaptureSchema2&,
+                                                          int, uint64_t, bool);
+
+    explicit ColumnCache(const std::filesystem::path& path) : file_(path) {}
+
+    MappedFile file_;
+    std::vector<BatchView> row_groups_;
+    uint64_t rows_ = 0;
+    uint64_t lines_ = 0;
+    uint64_t errors_ = 0;
+};
+
+// Maps the cache at path if it was made from the same input contents by the
+// same line parser revision with the same schema version and checksum
+// handling, and holds exactly the columns of the schema. Returns nullptr otherwise, including for missing or damaged files.
+std::unique_ptr<ColumnCache> open_column_cache(const std::filesystem::path& path, const CaptureSchema2& schema,
+                                               int schema_version, uint64_t source_hash, bool checksum_verified);
@@ -11,21 +11,109 @@
 #include <map>
 #include <regex>
 #include <filesystem>
+#include <optional>
 #include <ranges>
 
+#include "cached_reader.hpp"
+#include "csv_reader.hpp"
+#include "hash.hpp"
+#include "partitioned_writer.hpp"
 #include "parsing.hpp"
 #include "utils.hpp"
-
-void handle_error(int status) {
-    if (status != NC_NOERR) {
-        spdlog::error("NetCDF error (code {}): {}", status, nc_strerror(status));
-        exit(EXIT_FAILURE);
-    }
-}
+#include "validate.hpp"
 
 namespace fs = std::filesystem;
 using namespace indicators;
 
+int run_validate(const std::vector<std::string>& inputs, bool file_list, uint8_t schema_version,
+                 size_t block_size_mb, unsigned threads, const std::string& report_path) {
+    std::vector<fs::path> files;
+    for (const auto& input : inputs) {
+        if (file_list) {
+            auto listed = read_file_list(input);
+            files.insert(files.end(), listed.begin(), listed.end());
+        } else {
+            files.push_back(input);
+        }
+    }
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    spdlog::info("validating {} files on {} threads...", files.size(), threads);
+    auto reports = validate_files(files, schema_version, block_size_mb << 20, threads);
+
+    std::ofstream report_file;
+    if (!report_path.empty()) {
+        report_file.open(report_path);
+        report_file << "file,schema_version,rows,valid_rows,no_fix_rows,bad_rows";
+        for (size_t r = 1; r < row_error_count; r++) {
+            report_file << "," << row_error_names[r];
+        }
+        report_file << ",first_bad_line,first_bad_reason,gps_time_min,gps_time_max,cpu_seconds,error\n";
+    }
+
+    size_t files_with_errors = 0;
+    for (const auto& report : reports) {
+        if (!report.error.empty()) {
+            spdlog::error("{}: {}", report.path.string(), report.error);
+            files_with_errors++;
+            if (report_file.is_open()) {
+                std::string error = report.error;
+                for (size_t quote = 0; (quote = error.find('"', quote)) != std::string::npos; quote += 2) {
+                    error.insert(quote, 1, '"');
+                }
+                // Every count column stays empty, only the error is filled in
+                report_file << report.path.string() << "," << report.schema_version << std::string(row_error_count + 9, ',')
+                            << "\"" << error << "\"\n";
+            }
+            continue;
+        }
+
+        std::string reasons;
+        for (size_t r = 1; r < row_error_count; r++) {
+            if (report.bad_rows[r] > 0) {
+                reasons += std::format(" {}={}", row_error_names[r], report.bad_rows[r]);
+            }
+        }
+
+        bool has_times = report.has_gps_times();
+        uint64_t gps_time_min = has_times ? report.gps_time_min : 0;
+        uint64_t gps_time_max = has_times ? report.gps_time_max : 0;
+
+        if (report.total_bad_rows() > 0) {
+            files_with_errors++;
+            spdlog::warn("{}: {} rows, {} bad ({}), first bad line {} ({}), {} without fix, gps_time {}..{}",
+                report.path.filename().string(), report.rows, report.total_bad_rows(), reasons.substr(1),
+                report.first_bad_line, row_error_names[static_cast<size_t>(report.first_bad_reason)],
+                report.no_fix_rows, gps_time_min, gps_time_max);
+        } else {
+            spdlog::info("{}: {} rows, ok, {} without fix, gps_time {}..{}",
+                report.path.filename().string(), report.rows, report.no_fix_rows, gps_time_min, gps_time_max);
+        }
+
+        if (report_file.is_open()) {
+            report_file << report.path.string() << "," << report.schema_version << "," << report.rows << ","
+                        << report.valid_rows << "," << report.no_fix_rows << "," << report.total_bad_rows();
+            for (size_t r = 1; r < row_error_count; r++) {
+                report_file << "," << report.bad_rows[r];
+            }
+            report_file << "," << report.first_bad_line << ","
+                        << (report.first_bad_line ? row_error_names[static_cast<size_t>(report.first_bad_reason)] : "")
+                        << "," << gps_time_min << "," << gps_time_max << "," << report.seconds << ",\n";
+        }
+    }
+
+    if (files_with_errors > 0) {
+        spdlog::warn("{}/{} files failed validation", files_with_errors, reports.size());
+        return EXIT_FAILURE;
+    }
+
+    spdlog::info("all {} files passed validation", reports.size());
+    return 0;
+}
+
 int main(int argc, char **argv) {
     CLI::App app;
 
@@ -39,8 +127,7 @@ int main(int argc, char **argv) {
 
     std::string input_file_path;
     app.add_option("--input,-i", input_file_path, "CSV input file")
-        ->check(CLI::ExistingFile)
-        ->required();
+        ->check(CLI::ExistingFile);
 
     std::string output_file_path;
     app.add_option("--output,-o", output_file_path, "Output NetCDF file name");
@@ -60,6 +147,84 @@ int main(int argc, char **argv) {
     bool dont_write = false;
     app.add_flag("--dont-write", dont_write, "Don't write data to the NetCDF file");
 
+    size_t batch_rows = 64;
+    app.add_option("--batch-rows", batch_rows, "Rows buffered per NetCDF write")
+        ->default_val(64)
+        ->check(CLI::Range(1, 65536));
+
+    ReadAheadOptions read_options;
+    app.add_option("--read-ahead", read_options.depth, "Number of input reads kept in flight ahead of the parser")
+        ->default_val(4)
+        ->check(CLI::Range(1, 256));
+
+    size_t read_block_size = 4;
+    app.add_option("--read-block-size", read_block_size, "Size of each input read in MiB")
+        ->default_val(4)
+        ->check(CLI::Range(1, 1024));
+
+    bool no_io_uring = false;
+    app.add_flag("--no-io-uring", no_io_uring, "Use the pread thread pool instead of io_uring");
+
+    bool skip_unchanged = false;
+    app.add_flag("--skip-unchanged", skip_unchanged, "Keep an existing output converted from identical inputs with the same options");
+
+    std::string partition = "none";
+    app.add_option("--partition", partition, "Split output into one file per gps_time hour or day")
+        ->default_val("none")
+        ->check(CLI::IsMember({"none", "hourly", "daily"}));
+
+    uint64_t rollover_size = 0;
+    app.add_option("--rollover-size", rollover_size, "Start a new output file after this many MiB of uncompressed data, 0 to disable")
+        ->default_val(0);
+
+    bool fixed_length = false;
+    app.add_flag("--fixed-length", fixed_length, "Size the time dimension from the preprocessing row count and disable fill values");
+
+    bool contiguous = false;
+    app.add_flag("--contiguous", contiguous, "Store uncompressed variables contiguously, requires --fixed-length");
+
+    std::vector<std::string> columns;
+    app.add_option("--columns", columns, "Comma-separated columns to convert, all by default")
+        ->delimiter(',');
+
+    std::vector<std::string> exclude_columns;
+    app.add_option("--exclude-columns", exclude_columns, "Comma-separated columns to leave out")
+        ->delimiter(',');
+
+    bool verify_checksum = false;
+    app.add_flag("--verify-checksum", verify_checksum, "Verify row checksums even when samples are not converted");
+
+    bool sample_stats = false;
+    app.add_flag("--sample-stats", sample_stats, "Add per-row min, max, mean, RMS, clipped and saturated sample counts");
+
+    bool use_cache = false;
+    app.add_flag("--cache", use_cache, "Keep a parsed binary copy of each input and convert from it on later runs");
+
+    std::string cache_dir;
+    app.add_option("--cache-dir", cache_dir, "Directory for --cache files instead of next to the inputs, implies --cache");
+
+    CLI::App* validate = app.add_subcommand("validate", "Tokenize input files and verify checksums without writing NetCDF");
+
+    std::vector<std::string> validate_inputs;
+    validate->add_option("inputs", validate_inputs, "CSV input files (or file lists with --file-list)")
+        ->check(CLI::ExistingFile)
+        ->required();
+
+    bool validate_file_list = false;
+    validate->add_flag("--file-list", validate_file_list, "Treat inputs as lists of files");
+
+    unsigned validate_threads = 0;
+    validate->add_option("--threads,-j", validate_threads, "Worker threads, 0 for all cores")
+        ->default_val(0);
+
+    size_t validate_block_size = 64;
+    validate->add_option("--block-size", validate_block_size, "Block size in MiB handed to each worker")
+        ->default_val(64)
+        ->check(CLI::Range(1, 4096));
+
+    std::string validate_report;
+    validate->add_option("--report", validate_report, "Write the per-file report as CSV");
+
     CLI11_PARSE(app, argc, argv);
 
     // spdlog::set_pattern("[%^%L%$] [%H:%M:%S %z] [%n] [thread %t] %v");
@@ -72,6 +237,19 @@ int main(int argc, char **argv) {
         spdlog::set_level(spdlog::level::trace);
     }
 
+    if (validate->parsed()) {
+        return run_validate(validate_inputs, validate_file_list, schema_version,
+                            validate_block_size, validate_threads, validate_report);
+    }
+
+    if (input_file_path.empty()) {
+        spdlog::error("--input is required");
+        exit(EXIT_FAILURE);
+    }
+
+    read_options.block_size = read_block_size << 20;
+    read_options.use_io_uring = !no_io_uring;
+
     if (deflate) {
         spdlog::info("compression enabled at level {}.", deflate);
     }
@@ -79,17 +257,7 @@ int main(int argc, char **argv) {
     std::vector<fs::path> files;
 
     if (file_list) {
-        fs::path input_path = input_file_path;
-        fs::path input_directory = input_path.remove_filename();
-
-        std::ifstream file_stream;
-        file_stream.rdbuf()->pubsetbuf(0, 0);
-        file_stream.open(input_file_path);
-        for (std::string line; std::getline(file_stream, line);) {
-            files.push_back(input_directory / line);
-        }
-
-        spdlog::warn("not supported yet");
+        files = read_file_list(input_file_path);
     } else {
         files.push_back(input_file_path);
     }
@@ -116,12 +284,16 @@ int main(int argc, char **argv) {
 
     // Read metadata from the first file
     std::ifstream file;
-    file.rdbuf()->pubsetbuf(0, 0);
     file.open(files.front());
 
     if (schema_version == 0) {
         spdlog::warn("no schema version provided, detecting schema version from the first file...");
-        schema_version = get_schema_version(file);
+        try {
+            schema_version = get_schema_version(file);
+        } catch (const std::exception& e) {
+            spdlog::error("{}: {}", files.front().string(), e.what());
+            exit(EXIT_FAILURE);
+        }
         spdlog::debug("detected schema version {} from {}", schema_version, files.front().string());
     }
 
@@ -142,6 +314,30 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
     }
 
+    if (sample_stats && schema_version < 2) {
+        spdlog::error("--sample-stats needs schema version 2 or later");
+        exit(EXIT_FAILURE);
+    }
+    const CaptureSchema2 full_schema = sample_stats ? with_sample_stats(*schema2) : *schema2;
+
+    // Columns left out are never converted, and skipping samples skips most of each line
+    const bool projection = !columns.empty() || !exclude_columns.empty();
+    std::optional<CaptureSchema2> projected;
+    try {
+        projected.emplace(projection ? project_schema(full_schema, columns, exclude_columns) : full_schema);
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        exit(EXIT_FAILURE);
+    }
+
+    std::string projected_columns;
+    for (const auto& column : projected->columns) {
+        projected_columns += projected_columns.empty() ? column.label : "," + column.label;
+    }
+    if (projection) {
+        spdlog::info("converting columns: {}", projected_columns);
+    }
+
     ProgressBar bar{
         option::BarWidth{30},
         option::Start{"["},
@@ -156,22 +352,46 @@ int main(int argc, char **argv) {
         option::FontStyles{std::vector<FontStyle>{FontStyle::bold}},
     };
 
-    // Preprocess files
+    // Preprocess files, hashing their contents in the same pass that counts lines
     size_t total_lines = 0;
+    size_t total_data_lines = 0;
+    std::vector<std::string> source_hashes;
+    std::vector<uint64_t> file_hashes;
+    Xxh64 combined_hash;
     for (size_t i = 0; i < files.size(); i++) {
         const auto& file_path = files[i];
         bar.set_option(option::PostfixText{std::format("preprocessing {}/{} files", i, files.size())});
 
+        file.close();
+        file.clear();
         file.open(file_path);
 
-        const int file_schema_version = get_schema_version(file);
+        int file_schema_version;
+        try {
+            file_schema_version = get_schema_version(file);
+        } catch (const std::exception& e) {
+            spdlog::error("{}: {}", file_path.string(), e.what());
+            exit(EXIT_FAILURE);
+        }
 
         if (file_schema_version != schema_version) {
             spdlog::error("schema version mismatch: {} != {}", file_schema_version, schema_version);
             exit(EXIT_FAILURE);
         }
 
-        total_lines += count_data_lines_fast(file_path);
+        InputScan scan;
+        try {
+            scan = scan_input(file_path, read_options);
+        } catch (const std::exception& e) {
+            spdlog::error("{}", e.what());
+            exit(EXIT_FAILURE);
+        }
+
+        total_lines += scan.lines;
+        total_data_lines += scan.data_lines;
+        source_hashes.push_back(hash_to_hex(scan.hash));
+        file_hashes.push_back(scan.hash);
+        combined_hash.update(&scan.hash, sizeof(scan.hash));
         bar.set_progress((i + 1) * 100 / files.size());
     }
 
@@ -179,232 +399,178 @@ int main(int argc, char **argv) {
 
     bar.mark_as_completed();
 
-    spdlog::debug("total lines: {}", total_lines);
-
-    std::string line;
-
-    int ncid, time_dimid, sample_dimid;
-    std::map <std::string, int> varids;
-    std::map <std::string, int> dimids;
-    int varid, dimid;
-    int samples_varid;
-
-    spdlog::info("preparing netcdf file...");
-
-    // Create the file
-    std::string output_file_temp = output_file_path + ".tmp";
-    handle_error(nc_create(output_file_temp.c_str(), NC_NETCDF4, &ncid));
-
-    int format;
-    nc_inq_format(ncid, &format);
-    spdlog::debug("NetCDF format: {}", format);
-
-    if (schema_version > 1) {
-        auto file_path = files.front();
-        file.open(file_path);
-        std::map<std::string, std::string> metadata = parse_metadata(file);
-
-        nc_put_att(ncid, NC_GLOBAL, "original_schema_version", NC_BYTE, 1, &schema_version);
-        
-        for (auto const& [key, val] : metadata) {
-            std::string lower_key = key;
-            std::transform(lower_key.begin(), lower_key.end(), lower_key.begin(), ::tolower);
-            nc_put_att(ncid, NC_GLOBAL, lower_key.c_str(), NC_CHAR, val.length(), val.c_str());
+    spdlog::debug("total lines: {}, data lines: {}", total_lines, total_data_lines);
 
-            spdlog::debug("Added metadata: {} = {}", lower_key, val);
-        }
+    // Only options that change the output belong here
+    std::string conversion_options = std::format("schema_version={} deflate={}", schema_version, deflate);
+    if (scaffold) {
+        conversion_options += " scaffold";
+    }
+    if (dont_write) {
+        conversion_options += " dont_write";
     }
 
-    std::vector<char*> text;
-    text.reserve(files.size());
-
-    std::transform(files.begin(), files.end(), std::back_inserter(text), [](const fs::path& p) {
-        return strdup(p.filename().string().c_str());
-    });
-
-    handle_error(nc_put_att(ncid, NC_GLOBAL, "source_files", NC_STRING, text.size(), text.data()));
+    PartitionOptions partition_options;
+    partition_options.interval = partition == "hourly" ? PartitionInterval::Hourly
+                               : partition == "daily" ? PartitionInterval::Daily
+                               : PartitionInterval::None;
+    partition_options.rollover_bytes = rollover_size << 20;
 
-    // Define dimensions
-    handle_error(nc_def_dim(ncid, "time", NC_UNLIMITED, &time_dimid));
-    handle_error(nc_def_dim(ncid, "sample", 7200, &sample_dimid));
-    dimids["time"] = time_dimid;
-    dimids["sample"] = sample_dimid;
+    const bool partitioned = partition_options.interval != PartitionInterval::None || partition_options.rollover_bytes;
+    if (partitioned) {
+        conversion_options += std::format(" partition={} rollover_size={}", partition, rollover_size);
 
-    for (const ColumnSchema& column : schema2->columns) {
-        if (column.label == "samples") {
-            break;
+        if (skip_unchanged) {
+            spdlog::warn("--skip-unchanged is not supported with partitioned output, converting anyway");
+            skip_unchanged = false;
         }
 
-        int varid;
-        handle_error(nc_def_var(ncid, column.label.c_str(), column.netcdf_type, 1, &dimids["time"], &varid));
-
-        if (deflate) {
-            handle_error(nc_def_var_deflate(ncid, varid, 0, 1, deflate));
+        if (fixed_length) {
+            spdlog::error("--fixed-length cannot be combined with partitioned output");
+            exit(EXIT_FAILURE);
         }
+    }
 
-        if (!column.unit.empty()) {
-            nc_put_att(ncid, varid, "units", NC_CHAR, column.unit.length(), column.unit.c_str());
-        }
+    if (contiguous && !fixed_length) {
+        spdlog::error("--contiguous requires --fixed-length");
+        exit(EXIT_FAILURE);
+    }
 
-        varids[column.label] = varid;
-        spdlog::debug("created variable \"{}\" with type \"{}\"", column.label, column.netcdf_type);
+    if (fixed_length && (scaffold || dont_write)) {
+        spdlog::warn("--fixed-length has no effect without data, keeping the time dimension unlimited");
+        fixed_length = false;
+        contiguous = false;
     }
 
-    int dims[2] = {dimids["time"], dimids["sample"]};
-    // handle_error(nc_def_var(ncid, "parsing_errors", NC_INT, 2, dims, &varid));
-    // varids["parsing_errors"] = varid;
+    if (fixed_length) {
+        conversion_options += contiguous ? " fixed_length contiguous" : " fixed_length";
+    }
 
-    // Define the samples variable
-    handle_error(nc_def_var(ncid, "samples", NC_SHORT, 2, dims, &varid));
-    short valid_range[2] = {0, 1023};
-    handle_error(nc_put_att(ncid, varid, "valid_min", NC_SHORT, 1, &valid_range[0]));
-    handle_error(nc_put_att(ncid, varid, "valid_max", NC_SHORT, 1, &valid_range[1]));
-    varids["samples"] = varid;
-    if (deflate) {
-        handle_error(nc_def_var_deflate(ncid, varids["samples"], 0, 1, deflate));
+    if (projection) {
+        conversion_options += " columns=" + projected_columns;
+    }
+    if (sample_stats) {
+        conversion_options += " sample_stats";
+    }
+    if (verify_checksum) {
+        conversion_options += " verify_checksum";
     }
 
-    // End define mode
-    handle_error(nc_enddef(ncid));
+    std::string source_hash = hash_to_hex(combined_hash.digest());
+    spdlog::debug("source hash: {}", source_hash);
 
-    if (scaffold) {
-        spdlog::warn("Scaffold mode enabled, skipping data processing");
-        handle_error(nc_close(ncid));
-        spdlog::info("moving temporary file to final location... {}->{}", output_file_temp, output_file_path);    
-        fs::rename(output_file_temp, output_file_path);
-        spdlog::info("Successfully created NetCDF file: {}\n", output_file_path);
+    if (skip_unchanged && output_is_current(output_file_path, source_hash, conversion_options)) {
+        spdlog::info("{} is up to date, skipping conversion", output_file_path);
         return 0;
     }
 
-    // Read data lines
-    ProgressBar bar2{
-        option::BarWidth{30},
-        option::Start{"["},
-        option::Fill{"="},
-        option::Lead{">"},
-        option::Remainder{" "},
-        option::End{"]"},
-        option::PostfixText{"Processing data lines"},
-        option::ForegroundColor{Color::yellow},
-        option::ShowElapsedTime{true},
-        option::ShowRemainingTime{true},
-        option::FontStyles{std::vector<FontStyle>{FontStyle::bold}},
-    };
-
-    bar2.set_option(option::PostfixText{"processing"});
+    spdlog::info("preparing netcdf file...");
 
-    uint64_t errors = 0;
-    size_t lines = 0;
-    size_t time_coord = 0;
-    spdlog::info("processing data lines...");
-    std::ios::sync_with_stdio(false);
-    for (size_t i = 0; i < files.size(); i++) {
-        const auto& file_path = files[i];
-        std::ifstream file;
-        file.open(file_path);
+    WriterOptions writer_options;
+    writer_options.deflate = deflate;
+    writer_options.schema_version = schema_version;
+    writer_options.source_hashes = source_hashes;
+    writer_options.source_hash = source_hash;
+    writer_options.conversion_options = conversion_options;
+
+    if (fixed_length) {
+        writer_options.time_length = total_data_lines;
+        writer_options.contiguous = contiguous;
+        spdlog::info("using a fixed time dimension of {} rows", total_data_lines);
+    }
 
-        file.clear();
-        file.seekg(0, std::ios::beg);
+    if (schema_version > 1) {
+        std::ifstream metadata_file(files.front());
+        try {
+            writer_options.metadata = parse_metadata(metadata_file);
+        } catch (const std::exception& e) {
+            spdlog::error("{}: {}", files.front().string(), e.what());
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        for (std::string line; std::getline(file, line);) {
-            bar2.set_progress(lines * 100 / total_lines);
-            bar2.set_option(option::PostfixText{std::format("{}/{} lines, {}/{} files, {} errors", lines, total_lines, i, files.size(), errors)});
-            lines++;
+    for (const auto& file_path : files) {
+        writer_options.source_files.push_back(file_path.filename().string());
+    }
 
-            if (line.empty() || line.at(0) == '#') {
-                continue;
-            }
+    try {
+        PartitionedWriter writer(output_file_path, *projected, writer_options, partition_options);
 
-            try {
+        if (scaffold) {
+            spdlog::warn("Scaffold mode enabled, skipping data processing");
+            writer.close();
+            spdlog::info("Successfully created NetCDF file: {}\n", output_file_path);
+            return 0;
+        }
 
-                std::map<std::string, std::any> parsed;
+        // Read data lines
+        ProgressBar bar2{
+            option::BarWidth{30},
+            option::Start{"["},
+            option::Fill{"="},
+            option::Lead{">"},
+            option::Remainder{" "},
+            option::End{"]"},
+            option::PostfixText{"Processing data lines"},
+            option::ForegroundColor{Color::yellow},
+            option::ShowElapsedTime{true},
+            option::ShowRemainingTime{true},
+            option::FontStyles{std::vector<FontStyle>{FontStyle::bold}},
+        };
+
+        bar2.set_option(option::PostfixText{"processing"});
+
+        spdlog::info("processing data lines...");
+
+        auto consume = [&](const BatchView& rows, size_t lines, uint64_t errors, size_t file_index) {
+            if (!dont_write) {
+                writer.set_parsing_errors(errors);
+                writer.append(rows);
+            }
 
-                if (schema_version == 1) {
-                    spdlog::error("Schema version 1 not supported");
-                    exit(EXIT_FAILURE);
-                } else if (schema_version == 2) {
-                    parsed = parse_line_v2(line);
-                } else if (schema_version == 3) {
-                    parsed = parse_line_v3(line);
-                }
+            bar2.set_progress(std::min<size_t>(lines * 100 / std::max<size_t>(total_lines, 1), 100));
+            bar2.set_option(option::PostfixText{std::format("{}/{} lines, {}/{} files, {} errors",
+                lines, total_lines, file_index, files.size(), errors)});
+        };
 
-                if (dont_write) {
-                    continue;
-                }
+        uint64_t errors_done = 0;
+        if (!use_cache && cache_dir.empty()) {
+            CsvReader reader(files, *projected, schema_version, read_options, verify_checksum);
+            Batch batch(*projected);
+            batch.reserve(batch_rows);
 
-                for (const auto& column : schema2->columns) {
-
-                    if (parsed.find(column.label) == parsed.end()) {
-                        spdlog::error("missing column: {}", column.label);
-                        continue;
-                    }
-
-                    if (column.label == "samples") {
-                        size_t startp[2] = {time_coord, 0};
-                        size_t countp[2] = {1, static_cast<size_t>(7200)};
-
-                        std::vector<int> samples = std::any_cast<std::vector<int>>(parsed["samples"]);
-                        std::vector<short> samples_short(samples.begin(), samples.end());
-                        nc_put_vara_short(ncid, varids["samples"], startp, countp, samples_short.data());
-                        continue;
-                    }
-
-                    if (column.netcdf_type == NC_INT) {
-                        int int_value = std::any_cast<int>(parsed[column.label]);
-                        nc_put_var1_int(ncid, varids[column.label], &time_coord, &int_value);
-                    } else if (column.netcdf_type == NC_DOUBLE) {
-                        double value = std::any_cast<double>(parsed[column.label]);
-                        nc_put_var1_double(ncid, varids[column.label], &time_coord, &value);
-                    } else if (column.netcdf_type == NC_BYTE) {
-                        int byte_value = std::any_cast<char>(parsed[column.label]);
-                        nc_put_var1_int(ncid, varids[column.label], &time_coord, &byte_value);
-                    } else if (column.netcdf_type == NC_SHORT) {
-                        short short_value = std::any_cast<short>(parsed[column.label]);
-                        nc_put_var1_short(ncid, varids[column.label], &time_coord, &short_value);
-                    } else if (column.netcdf_type == NC_STRING) {
-                        std::string str_value = std::any_cast<std::string>(parsed[column.label]);
-                        nc_put_var1_text(ncid, varids[column.label], &time_coord, str_value.c_str());
-                    } else if (column.netcdf_type == NC_INT64) {
-                        int64_t int64_value = std::any_cast<int64_t>(parsed[column.label]);
-                        nc_put_var1_longlong(ncid, varids[column.label], &time_coord, &int64_value);
-                    } else if (column.netcdf_type == NC_UINT) {
-                        unsigned int uint_value = std::any_cast<unsigned int>(parsed[column.label]);
-                        nc_put_var1_uint(ncid, varids[column.label], &time_coord, &uint_value);
-                    } else if (column.netcdf_type == NC_UINT64) {
-                        unsigned long long uint64_value = std::any_cast<unsigned long long>(parsed[column.label]);
-                        nc_put_var1_ulonglong(ncid, varids[column.label], &time_coord, &uint64_value);
-                    } else {
-                        spdlog::error("unsupported NetCDF type: {}", column.netcdf_type);
-                        exit(EXIT_FAILURE);
-                    }
-                }
-            } catch (const std::exception& e) {
-                spdlog::debug("Error parsing line {}: {}\nLINE: {}", lines, e.what(), line.substr(0, 20));
-                errors++;
-                continue;
+            while (reader.next(batch, batch_rows)) {
+                consume(batch.view(), reader.lines(), reader.errors(), reader.file_index());
             }
+            errors_done = reader.errors();
+        } else {
+            CachedReader reader(files, file_hashes, *projected, schema_version, cache_dir, read_options, verify_checksum);
 
-            time_coord++;
+            for (BatchView rows; reader.next(rows, batch_rows);) {
+                consume(rows, reader.lines(), reader.errors(), reader.file_index());
+            }
+            errors_done = reader.errors();
         }
-    }
-    std::ios::sync_with_stdio(true);
-
-    bar2.mark_as_completed();
 
-    if (errors > 0) {
-        spdlog::warn("Encountered {} errors while parsing the input file", errors);
-    }
+        bar2.mark_as_completed();
 
-    handle_error(nc_put_att(ncid, NC_GLOBAL, "parsing_errors", NC_INT64, 1, &errors));
-    handle_error(nc_put_att(ncid, NC_GLOBAL, "complete", NC_CHAR, 4, "yes"));
+        if (errors_done > 0) {
+            spdlog::warn("Encountered {} errors while parsing the input file", errors_done);
+        }
 
-    // Close the file
-    handle_error(nc_close(ncid));
+        writer.set_parsing_errors(errors_done);
+        writer.close();
 
-    // Move the temporary file to the final location
-    spdlog::info("moving temporary file to final location... {}->{}", output_file_temp, output_file_path);
-    fs::rename(output_file_temp, output_file_path);
+        if (partitioned) {
+            for (const auto& output : writer.outputs()) {
+                spdlog::info("wrote partition {}", output.string());
+            }
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        exit(EXIT_FAILURE);
+    }
 
     spdlog::info("successfully created NetCDF file: {}", output_file_path);
     return 0;
-}
\ No newline at end of file
+}
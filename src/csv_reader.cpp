@@ -0,0 +1,116 @@
+#include "csv_reader.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <format>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+CsvReader::CsvReader(std::vector<fs::path> files, const CaptureSchema2& schema, int schema_version,
+                     const ReadAheadOptions& read_options, bool verify_checksum)
+    : files_(std::move(files)), schema_(schema), schema_version_(schema_version), read_options_(read_options),
+      decoder_(make_line_decoder(schema_version, schema, verify_checksum)) {
+}
+
+bool CsvReader::open_next() {
+    if (opened_) {
+        file_index_++;
+    }
+
+    block_ = {};
+    current_.reset();
+
+    if (file_index_ >= files_.size()) {
+        return false;
+    }
+
+    if (prefetched_) {
+        current_ = std::move(prefetched_);
+    } else {
+        current_ = std::make_unique<ReadAhead>(files_[file_index_], read_options_);
+    }
+    opened_ = true;
+    return true;
+}
+
+void CsvReader::prefetch_next_file() {
+    if (prefetched_ || !current_ || !current_->fully_submitted() || file_index_ + 1 >= files_.size()) {
+        return;
+    }
+
+    spdlog::debug("prefetching {}", files_[file_index_ + 1].string());
+    prefetched_ = std::make_unique<ReadAhead>(files_[file_index_ + 1], read_options_);
+}
+
+// Returns the next line of the current file. A line that straddles two blocks
+// is stitched together in the output string, and a trailing '\r' is dropped so
+// CRLF input parses the same as LF input.
+bool CsvReader::next_line(std::string& line) {
+    line.clear();
+
+    for (;;) {
+        if (block_.empty()) {
+            block_ = current_->next();
+            prefetch_next_file();
+
+            if (block_.empty()) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                return !line.empty();
+            }
+        }
+
+        size_t newline = block_.find('\n');
+        if (newline == std::string_view::npos) {
+            line.append(block_);
+            block_ = {};
+            continue;
+        }
+
+        line.append(block_.substr(0, newline));
+        block_.remove_prefix(newline + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return true;
+    }
+}
+
+bool CsvReader::next(Batch& batch, size_t max_rows) {
+    batch.clear();
+
+    if (!opened_ && !open_next()) {
+        return false;
+    }
+
+    std::string line;
+    while (batch.rows < max_rows) {
+        if (!current_ || !next_line(line)) {
+            if (!open_next()) {
+                break;
+            }
+            continue;
+        }
+
+        lines_++;
+
+        if (line.empty() || line.at(0) == '#') {
+            continue;
+        }
+
+        try {
+            if (schema_version_ == 2) {
+                parse_line_v2(line, decoder_, batch);
+            } else {
+                parse_line_v3(line, decoder_, batch);
+            }
+        } catch (const std::exception& e) {
+            spdlog::debug("Error parsing line {}: {}\nLINE: {}", lines_, e.what(), line.substr(0, 20));
+            errors_++;
+        }
+    }
+
+    return batch.rows > 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch.hpp"
+#include "parsing.hpp"
+#include "read_ahead.hpp"
+
+// Reads capture CSV files in order and turns their data lines into batches.
+// Only the schema's columns are decoded, so a projected schema skips the
+// rest. Lines that fail to parse are counted and skipped. Input is read through
+// ReadAhead, and the next file is primed once the current one has no reads
+// left to queue.
+class CsvReader {
+public:
+    CsvReader(std::vector<std::filesystem::path> files, const CaptureSchema2& schema, int schema_version,
+              const ReadAheadOptions& read_options = {}, bool verify_checksum = true);
+
+    // Fills the batch with up to max_rows rows. Returns false once every file
+    // has been consumed and no rows were read.
+    bool next(Batch& batch, size_t max_rows);
+
+    uint64_t errors() const {
+        return errors_;
+    }
+
+    size_t lines() const {
+        return lines_;
+    }
+
+    size_t file_index() const {
+        return file_index_;
+    }
+
+private:
+    bool open_next();
+    bool next_line(std::string& line);
+    void prefetch_next_file();
+
+    std::vector<std::filesystem::path> files_;
+    CaptureSchema2 schema_;
+    int schema_version_;
+    ReadAheadOptions read_options_;
+    LineDecoder decoder_;
+    std::unique_ptr<ReadAhead> current_;
+    std::unique_ptr<ReadAhead> prefetched_;
+    std::string_view block_;
+    size_t file_index_ = 0;
+    bool opened_ = false;
+    size_t lines_ = 0;
+    uint64_t errors_ = 0;
+};
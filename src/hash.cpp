@@ -0,0 +1,120 @@
+#include "hash.hpp"
+
+#include <bit>
+#include <cstring>
+#include <format>
+
+static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * prime2;
+    acc = std::rotl(acc, 31);
+    return acc * prime1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+    acc ^= xxh_round(0, value);
+    return acc * prime1 + prime4;
+}
+
+Xxh64::Xxh64(uint64_t seed)
+    : v1_(seed + prime1 + prime2), v2_(seed + prime2), v3_(seed), v4_(seed - prime1), seed_(seed) {
+}
+
+void Xxh64::update(const void* data, size_t length) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + length;
+    total_length_ += length;
+
+    if (buffered_ + length < sizeof(buffer_)) {
+        std::memcpy(buffer_ + buffered_, p, length);
+        buffered_ += length;
+        return;
+    }
+
+    if (buffered_ > 0) {
+        size_t fill = sizeof(buffer_) - buffered_;
+        std::memcpy(buffer_ + buffered_, p, fill);
+        v1_ = xxh_round(v1_, read64(buffer_));
+        v2_ = xxh_round(v2_, read64(buffer_ + 8));
+        v3_ = xxh_round(v3_, read64(buffer_ + 16));
+        v4_ = xxh_round(v4_, read64(buffer_ + 24));
+        p += fill;
+        buffered_ = 0;
+    }
+
+    while (p + 32 <= end) {
+        v1_ = xxh_round(v1_, read64(p));
+        v2_ = xxh_round(v2_, read64(p + 8));
+        v3_ = xxh_round(v3_, read64(p + 16));
+        v4_ = xxh_round(v4_, read64(p + 24));
+        p += 32;
+    }
+
+    buffered_ = static_cast<size_t>(end - p);
+    std::memcpy(buffer_, p, buffered_);
+}
+
+uint64_t Xxh64::digest() const {
+    uint64_t h;
+
+    if (total_length_ >= 32) {
+        h = std::rotl(v1_, 1) + std::rotl(v2_, 7) + std::rotl(v3_, 12) + std::rotl(v4_, 18);
+        h = merge_round(h, v1_);
+        h = merge_round(h, v2_);
+        h = merge_round(h, v3_);
+        h = merge_round(h, v4_);
+    } else {
+        h = seed_ + prime5;
+    }
+
+    h += total_length_;
+
+    const unsigned char* p = buffer_;
+    const unsigned char* end = buffer_ + buffered_;
+
+    while (p + 8 <= end) {
+        h ^= xxh_round(0, read64(p));
+        h = std::rotl(h, 27) * prime1 + prime4;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * prime1;
+        h = std::rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= static_cast<uint64_t>(*p) * prime5;
+        h = std::rotl(h, 11) * prime1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::string hash_to_hex(uint64_t hash) {
+    return std::format("{:016x}", hash);
+}
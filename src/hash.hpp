@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Streaming XXH64, used to fingerprint input files cheaply enough to run
+// during the preprocessing scan.
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0);
+
+    void update(const void* data, size_t length);
+    uint64_t digest() const;
+
+private:
+    uint64_t v1_, v2_, v3_, v4_;
+    uint64_t seed_;
+    uint64_t total_length_ = 0;
+    unsigned char buffer_[32];
+    size_t buffered_ = 0;
+};
+
+std::string hash_to_hex(uint64_t hash);
@@ -0,0 +1,370 @@
+#include "parsing.hpp"
+#include "batch.hpp"
+#include "sample_stats.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <format>
+#include <regex>
+#include <variant>
+
+std::map<std::string, std::string> parse_metadata(std::istream& stream) {
+    enum class ReadState {
+        Scanning,
+        Metadata,
+        Data
+    };
+
+    std::string line;
+    std::map <std::string, std::string> metadata;
+
+    ReadState readState = ReadState::Scanning;
+    for (std::string line; std::getline(stream, line);) {
+
+        // each line should be small enough to not be a memory issue since it's less than a second of data
+        if (!stream.good()) {
+            throw std::runtime_error("Failed to read the first line of the input file");
+        }
+
+        if (line == "## BEGIN METADATA ##") {
+            readState = ReadState::Metadata;
+            continue;
+        }
+
+        if (readState == ReadState::Metadata) {
+            if (line.length() <= 1) {
+                continue;
+            }
+
+            if (line.at(0) != '#') {
+                spdlog::debug("Found line missing # in metadata");
+                continue;
+            }
+
+            line = line.substr(1);
+
+            // Read the line as metadata
+            std::regex metadata_regex("\\s*([A-Z_]+)\\s+(.*)");
+            std::smatch match;
+            if (std::regex_match(line, match, metadata_regex)) {
+                std::string key = match[1];
+                std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+                std::string value = match[2];
+                metadata[key] = value;
+            }
+        }
+
+        if (line.find("END METADATA") != std::string::npos) {
+            if (readState != ReadState::Metadata) {
+                throw std::runtime_error("Unexpected end of metadata section");
+            }
+
+            readState = ReadState::Data;
+            break;
+        }
+    
+    }
+
+    return metadata;
+}
+
+CaptureSchema2 project_schema(const CaptureSchema2& schema, const std::vector<std::string>& columns,
+                              const std::vector<std::string>& exclude) {
+    auto known = [&](const std::string& label) {
+        return std::any_of(schema.columns.begin(), schema.columns.end(),
+                           [&](const ColumnSchema& column) { return column.label == label; });
+    };
+
+    for (const auto& label : columns) {
+        if (!known(label)) {
+            throw std::runtime_error(std::format("unknown column: {}", label));
+        }
+    }
+    for (const auto& label : exclude) {
+        if (!known(label)) {
+            throw std::runtime_error(std::format("unknown column: {}", label));
+        }
+    }
+
+    std::vector<ColumnSchema> projected;
+    for (const ColumnSchema& column : schema.columns) {
+        bool wanted = columns.empty() || std::find(columns.begin(), columns.end(), column.label) != columns.end();
+        bool excluded = std::find(exclude.begin(), exclude.end(), column.label) != exclude.end();
+        if (wanted && !excluded) {
+            projected.push_back(column);
+        }
+    }
+
+    if (projected.empty()) {
+        throw std::runtime_error("column selection leaves no columns");
+    }
+
+    return CaptureSchema2{.columns = projected};
+}
+
+CaptureSchema2 with_sample_stats(const CaptureSchema2& schema) {
+    std::vector<ColumnSchema> columns = schema.columns;
+    columns.insert(columns.end(), sample_stats_schema.columns.begin(), sample_stats_schema.columns.end());
+    return CaptureSchema2{.columns = columns};
+}
+
+struct LineField {
+    const char* label;
+    uint32_t netcdf_type;
+};
+
+// Fields before the sample block, in file order. NC_CHAR marks the flags field.
+static const std::vector<LineField> v2_fields = {
+    {"gps_time", NC_UINT64},
+    {"flags", NC_CHAR},
+    {"sample_rate", NC_DOUBLE},
+    {"latitude", NC_DOUBLE},
+    {"longitude", NC_DOUBLE},
+    {"elevation", NC_DOUBLE},
+    {"satellite_count", NC_INT},
+    {"speed", NC_DOUBLE},
+    {"heading", NC_DOUBLE},
+    {"count_samples", NC_INT},
+};
+
+static const std::vector<LineField> v3_fields = {
+    {"cpu_time", NC_DOUBLE},
+    {"gps_time", NC_UINT64},
+    {"flags", NC_CHAR},
+    {"sample_rate", NC_DOUBLE},
+    {"latitude", NC_DOUBLE},
+    {"longitude", NC_DOUBLE},
+    {"elevation", NC_DOUBLE},
+    {"satellite_count", NC_INT},
+    {"speed", NC_DOUBLE},
+    {"heading", NC_DOUBLE},
+    {"count_samples", NC_INT},
+};
+
+static const std::vector<LineField>& line_fields(int schema_version) {
+    switch (schema_version) {
+        case 2:
+            return v2_fields;
+        case 3:
+            return v3_fields;
+        default:
+            throw std::runtime_error(std::format("Schema version {} not supported", schema_version));
+    }
+}
+
+LineDecoder make_line_decoder(int schema_version, const CaptureSchema2& schema, bool verify_checksum) {
+    auto column_index = [&](const std::string& label) {
+        for (size_t i = 0; i < schema.columns.size(); i++) {
+            if (schema.columns[i].label == label) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    };
+
+    LineDecoder decoder;
+    decoder.schema_version = schema_version;
+    for (const LineField& field : line_fields(schema_version)) {
+        decoder.field_columns.push_back(field.netcdf_type == NC_CHAR ? -1 : column_index(field.label));
+    }
+    decoder.has_gps_column = column_index("has_gps");
+    decoder.clipping_column = column_index("clipping");
+    decoder.samples_column = column_index("samples");
+    for (const ColumnSchema& column : sample_stats_schema.columns) {
+        decoder.stat_columns.push_back(column_index(column.label));
+        decoder.sample_stats = decoder.sample_stats || decoder.stat_columns.back() >= 0;
+    }
+    decoder.verify_checksum = verify_checksum || decoder.samples_column >= 0 || decoder.sample_stats;
+    return decoder;
+}
+
+// Splits off the next field, throwing when the line ends early.
+static std::string_view take_field(std::string_view& rest, bool& at_end, const char* label) {
+    if (at_end) {
+        throw ParseError(RowError::MissingField, std::format("missing field: {}", label));
+    }
+
+    size_t comma = rest.find(',');
+    std::string_view field = rest.substr(0, comma);
+    if (comma == std::string_view::npos) {
+        at_end = true;
+        rest = {};
+    } else {
+        rest.remove_prefix(comma + 1);
+    }
+    return field;
+}
+
+template<typename T>
+static T convert_field(std::string_view field, const char* label) {
+    T value;
+    if (!parse_field(field, value)) {
+        throw ParseError(RowError::InvalidNumber, std::format("invalid {}: \"{}\"", label, field));
+    }
+    return value;
+}
+
+static void parse_line(std::string_view line, const std::vector<LineField>& fields, const LineDecoder& decoder, Batch& batch) {
+    if (decoder.field_columns.size() != fields.size()) {
+        throw std::runtime_error(std::format("decoder was built for schema version {}", decoder.schema_version));
+    }
+
+    using FieldValue = std::variant<std::monostate, double, uint64_t, int32_t>;
+    std::array<FieldValue, 16> values{};
+    int8_t has_gps = 0;
+    int8_t clipping = 0;
+
+    // The sample block is only tokenized when it is stored or checked. Without
+    // it, parsing stops after the last field that has a column.
+    const bool need_flags = decoder.has_gps_column >= 0 || decoder.clipping_column >= 0;
+    const bool need_samples = decoder.samples_column >= 0 || decoder.verify_checksum;
+    size_t field_count = fields.size();
+    if (!need_samples) {
+        while (field_count > 0) {
+            const LineField& field = fields[field_count - 1];
+            if (decoder.field_columns[field_count - 1] >= 0 || (field.netcdf_type == NC_CHAR && need_flags)) {
+                break;
+            }
+            field_count--;
+        }
+    }
+
+    std::string_view rest = line;
+    bool at_end = false;
+    for (size_t i = 0; i < field_count; i++) {
+        const LineField& field = fields[i];
+        const int column = decoder.field_columns[i];
+        std::string_view token = take_field(rest, at_end, field.label);
+
+        if (field.netcdf_type == NC_CHAR) {
+            has_gps = token.find('G') != std::string_view::npos;
+            clipping = token.find('C') != std::string_view::npos;
+            continue;
+        }
+
+        if (column < 0) {
+            continue;
+        }
+
+        switch (field.netcdf_type) {
+            case NC_DOUBLE:
+                values[i] = convert_field<double>(token, field.label);
+                break;
+            case NC_UINT64:
+                values[i] = convert_field<uint64_t>(token, field.label);
+                break;
+            case NC_INT:
+                values[i] = convert_field<int32_t>(token, field.label);
+                break;
+        }
+    }
+
+    SampleStats stats;
+    if (need_samples) {
+        if (at_end) {
+            throw ParseError(RowError::MissingField, "missing samples");
+        }
+
+        // Samples are decoded straight into the batch when it stores them,
+        // and rolled back on failure. Otherwise they only feed the checksum
+        // and the statistics.
+        std::vector<int16_t>* samples = decoder.samples_column >= 0 ? &batch.column<int16_t>(decoder.samples_column) : nullptr;
+        const size_t samples_start = samples ? samples->size() : 0;
+        std::array<int16_t, samples_per_row> scratch;
+        int16_t* decoded = scratch.data();
+        if (samples) {
+            samples->resize(samples_start + samples_per_row);
+            decoded = samples->data() + samples_start;
+        }
+
+        try {
+            int64_t sum = 0;
+            int64_t last = 0;
+            size_t count = 0;
+            while (!at_end) {
+                std::string_view token = take_field(rest, at_end, "samples");
+                int value = convert_field<int>(token, "sample");
+                if (count > 0) {
+                    if (count > samples_per_row) {
+                        throw ParseError(RowError::SampleCount, std::format("expected {} samples, got more", samples_per_row));
+                    }
+                    decoded[count - 1] = static_cast<int16_t>(last);
+                    sum += last;
+                }
+                last = value;
+                count++;
+            }
+
+            // The last value is the checksum, not a sample
+            if (count == 0 || count - 1 != samples_per_row) {
+                throw ParseError(RowError::SampleCount, std::format("expected {} samples, got {}", samples_per_row, count == 0 ? 0 : count - 1));
+            }
+            if (decoder.verify_checksum && sum != last) {
+                throw ParseError(RowError::Checksum, "Checksum failed");
+            }
+        } catch (...) {
+            if (samples) {
+                samples->resize(samples_start);
+            }
+            throw;
+        }
+
+        if (decoder.sample_stats) {
+            stats = compute_sample_stats({decoded, samples_per_row});
+        }
+    }
+
+    // Nothing can fail past this point
+    for (size_t i = 0; i < field_count; i++) {
+        const int column = decoder.field_columns[i];
+        if (column < 0) {
+            continue;
+        }
+        std::visit([&](auto value) {
+            using T = decltype(value);
+            if constexpr (std::is_same_v<T, double>) {
+                batch.column<double>(column).push_back(value);
+            } else if constexpr (std::is_same_v<T, uint64_t>) {
+                batch.column<uint64_t>(column).push_back(value);
+            } else if constexpr (std::is_same_v<T, int32_t>) {
+                batch.column<int32_t>(column).push_back(value);
+            }
+        }, values[i]);
+    }
+    if (decoder.has_gps_column >= 0) {
+        batch.column<int8_t>(decoder.has_gps_column).push_back(has_gps);
+    }
+    if (decoder.clipping_column >= 0) {
+        batch.column<int8_t>(decoder.clipping_column).push_back(clipping);
+    }
+
+    if (decoder.sample_stats) {
+        const double mean = static_cast<double>(stats.sum) / samples_per_row;
+        const double rms = std::sqrt(static_cast<double>(stats.sum_squares) / samples_per_row);
+        // In sample_stats_schema order
+        const std::array<std::variant<int32_t, double>, 6> values = {
+            int32_t{stats.min}, int32_t{stats.max}, mean, rms,
+            static_cast<int32_t>(stats.clipped), static_cast<int32_t>(stats.saturated)
+        };
+        for (size_t i = 0; i < values.size(); i++) {
+            const int column = decoder.stat_columns[i];
+            if (column < 0) {
+                continue;
+            }
+            std::visit([&](auto value) {
+                batch.column<decltype(value)>(column).push_back(value);
+            }, values[i]);
+        }
+    }
+
+    batch.rows++;
+}
+
+void parse_line_v2(std::string_view line, const LineDecoder& decoder, Batch& batch) {
+    parse_line(line, v2_fields, decoder, batch);
+}
+
+void parse_line_v3(std::string_view line, const LineDecoder& decoder, Batch& batch) {
+    parse_line(line, v3_fields, decoder, batch);
+}
@@ -2,13 +2,27 @@
 #define PARSING_HPP
 
 #include "netcdf.h"
+#include "spdlog/spdlog.h"
 
 #include <vector>
 #include <string>
 #include <cstdint>
 #include <expected>
-#include <any>
 #include <tuple>
+#include <string_view>
+#include <charconv>
+#include <optional>
+#include <map>
+#include <sstream>
+#include <istream>
+#include <stdexcept>
+
+// Every capture row carries one second of samples.
+constexpr size_t samples_per_row = 7200;
+
+// Bump whenever a change to the line parsers changes which rows they accept or
+// what they decode, so stored results of an older parser are not reused.
+constexpr uint32_t line_parser_revision = 1;
 
 struct ColumnSchema {
     std::string label;
@@ -172,200 +186,109 @@ const CaptureSchema2 v3_schema = {
     }
 };
 
-
-template<typename T, typename E>
-T try_read_token(std::istringstream& stream, const std::string& token_name) {
-    spdlog::trace("reading token: {}", token_name);
-    std::string token;
-    if (!std::getline(stream, token, ',').good()) {
-        if (stream.eof()) {
-            throw std::runtime_error("Failed to read token, reason: EOF");
-        } else if (stream.fail()) {
-            throw std::runtime_error("Failed to read token, reason: stream failed");
-        } else if (stream.bad()) {
-            throw std::runtime_error("Failed to read token, reason: stream bad");
-        }
-    }
-    
-    if constexpr (std::is_same_v<T, double>) {
-        return std::stod(token);
-    } else if constexpr (std::is_same_v<T, int> || std::is_same_v<T, uint32_t>) {
-        return static_cast<T>(std::stoi(token));
-    } else if constexpr (std::is_same_v<T, uint64_t>) {
-        return static_cast<T>(std::stoull(token));
-    } else if constexpr (std::is_same_v<T, int64_t>) {
-        return static_cast<T>(std::stoll(token));
-    } else if constexpr (std::is_same_v<T, std::string>) {
-        return token;
-    }
-    
-    throw std::runtime_error("Invalid type for try_read_token");
-}
-
-std::map<std::string, std::string> parse_metadata(std::istream& stream) {
-    enum class ReadState {
-        Scanning,
-        Metadata,
-        Data
-    };
-
-    std::string line;
-    std::map <std::string, std::string> metadata;
-
-    ReadState readState = ReadState::Scanning;
-    for (std::string line; std::getline(stream, line);) {
-
-        // each line should be small enough to not be a memory issue since it's less than a second of data
-        if (!stream.good()) {
-            spdlog::error("Failed to read the first line of the input file");
-            exit(EXIT_FAILURE);
-        }
-
-        if (line == "## BEGIN METADATA ##") {
-            readState = ReadState::Metadata;
-            continue;
-        }
-
-        if (readState == ReadState::Metadata) {
-            if (line.length() <= 1) {
-                continue;
-            }
-
-            if (line.at(0) != '#') {
-                spdlog::debug("Found line missing # in metadata");
-                continue;
-            }
-
-            line = line.substr(1);
-
-            // Read the line as metadata
-            std::regex metadata_regex("\\s*([A-Z_]+)\\s+(.*)");
-            std::smatch match;
-            if (std::regex_match(line, match, metadata_regex)) {
-                std::string key = match[1];
-                std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-                std::string value = match[2];
-                metadata[key] = value;
-            }
-        }
-
-        if (line.find("END METADATA") != std::string::npos) {
-            if (readState != ReadState::Metadata) {
-                spdlog::error("Unexpected end of metadata section");
-                exit(EXIT_FAILURE);
-            }
-
-            readState = ReadState::Data;
-            break;
+// Optional per-row reductions over the samples, computed while the line is
+// decoded. See SampleStats for what clipped and saturated count. mean and rms
+// are taken over the raw ADC counts.
+const CaptureSchema2 sample_stats_schema = {
+    .columns = {
+        ColumnSchema{
+            .label = "samples_min",
+            .unit = "",
+            .netcdf_type = NC_INT
+        },
+        ColumnSchema{
+            .label = "samples_max",
+            .unit = "",
+            .netcdf_type = NC_INT
+        },
+        ColumnSchema{
+            .label = "samples_mean",
+            .unit = "",
+            .netcdf_type = NC_DOUBLE
+        },
+        ColumnSchema{
+            .label = "samples_rms",
+            .unit = "",
+            .netcdf_type = NC_DOUBLE
+        },
+        ColumnSchema{
+            .label = "samples_clipped",
+            .unit = "",
+            .netcdf_type = NC_INT
+        },
+        ColumnSchema{
+            .label = "samples_saturated",
+            .unit = "",
+            .netcdf_type = NC_INT
         }
-    
-    }
-
-    return metadata;
-}
-
-std::map<std::string, std::any> parse_line_v2(const std::string& line) {
-    std::string token;
-    std::istringstream tokenStream(line);
-
-    uint64_t gps_time = try_read_token<uint64_t, std::string>(tokenStream, "gps_time");
-    std::string flags = try_read_token<std::string, std::string>(tokenStream, "flags");
-    double sample_rate = try_read_token<double, std::string>(tokenStream, "sample_rate");
-    double latitude = try_read_token<double, std::string>(tokenStream, "latitude");
-    double longitude = try_read_token<double, std::string>(tokenStream, "longitude");
-    double elevation = try_read_token<double, std::string>(tokenStream, "elevation");
-    int satellite_count = try_read_token<int, std::string>(tokenStream, "satellite_count");
-    double speed = try_read_token<double, std::string>(tokenStream, "speed");
-    double heading = try_read_token<double, std::string>(tokenStream, "heading");
-    int count_samples = try_read_token<int, std::string>(tokenStream, "count_samples");
-
-    char clipping = flags.find('C') != std::string::npos;
-    char has_gps = flags.find('G') != std::string::npos;
-
-    // Read data
-    std::vector<int> tokens;
-    tokens.reserve(count_samples);
-    while (std::getline(tokenStream, token, ',')) {
-        tokens.push_back(std::stoi(token));
-    }
-
-    auto checksum = tokens.back();
-    tokens.pop_back();
-
-    auto sum = std::accumulate(tokens.begin(), tokens.end(), 0);
-
-    if (sum != checksum) {
-        throw std::runtime_error("Checksum failed");
     }
+};
 
-    return std::map<std::string, std::any> {
-        {"gps_time", gps_time},
-        {"has_gps", has_gps},
-        {"clipping", clipping},
-        {"sample_rate", sample_rate},
-        {"latitude", latitude},
-        {"longitude", longitude},
-        {"elevation", elevation},
-        {"satellite_count", satellite_count},
-        {"speed", speed},
-        {"heading", heading},
-        {"count_samples", count_samples},
-        {"samples", tokens}
-    };
 
+template<typename T>
+bool parse_field(std::string_view field, T& value) {
+    const char* end = field.data() + field.size();
+    auto [ptr, ec] = std::from_chars(field.data(), end, value);
+    return ec == std::errc() && ptr == end;
 }
 
-std::map<std::string, std::any> parse_line_v3(const std::string& line) {
-    std::string token;
-    std::istringstream tokenStream(line);
-
-    double computer_time = try_read_token<double, std::string>(tokenStream, "cpu_time");
-    uint64_t gps_time = try_read_token<uint64_t, std::string>(tokenStream, "gps_time");
-    std::string flags = try_read_token<std::string, std::string>(tokenStream, "flags");
-    double sample_rate = try_read_token<double, std::string>(tokenStream, "sample_rate");
-    double latitude = try_read_token<double, std::string>(tokenStream, "latitude");
-    double longitude = try_read_token<double, std::string>(tokenStream, "longitude");
-    double elevation = try_read_token<double, std::string>(tokenStream, "elevation");
-    int satellite_count = try_read_token<int, std::string>(tokenStream, "satellite_count");
-    double speed = try_read_token<double, std::string>(tokenStream, "speed");
-    double heading = try_read_token<double, std::string>(tokenStream, "heading");
-    int count_samples = try_read_token<int, std::string>(tokenStream, "count_samples");
-
-    char clipping = flags.find('C') != std::string::npos;
-    char has_gps = flags.find('G') != std::string::npos;
+// Why a data line was rejected.
+enum class RowError : size_t {
+    None = 0,
+    MissingField,
+    InvalidNumber,
+    SampleCount,
+    Checksum,
+    Count
+};
 
-    // Read data
-    std::vector<int> tokens;
-    tokens.reserve(count_samples);
-    while (std::getline(tokenStream, token, ',')) {
-        tokens.push_back(std::stoi(token));
-    }
+// Thrown by the line parsers for a malformed line.
+class ParseError : public std::runtime_error {
+public:
+    ParseError(RowError reason, const std::string& message) : std::runtime_error(message), reason(reason) {}
 
-    auto checksum = tokens.back();
-    tokens.pop_back();
+    const RowError reason;
+};
 
-    auto sum = std::accumulate(tokens.begin(), tokens.end(), 0);
+// Reads the metadata block at the top of a capture. Throws on a malformed block.
+std::map<std::string, std::string> parse_metadata(std::istream& stream);
+
+// Keeps the columns named in `columns` (all of them when empty) minus those in
+// `exclude`, in schema order. Unknown names are an error.
+CaptureSchema2 project_schema(const CaptureSchema2& schema, const std::vector<std::string>& columns,
+                              const std::vector<std::string>& exclude);
+
+// Appends the sample_stats_schema columns to the schema.
+CaptureSchema2 with_sample_stats(const CaptureSchema2& schema);
+
+class Batch;
+
+// Where each field of a capture line goes in a Batch laid out after a
+// (possibly projected) schema. Fields without a column are skipped without
+// being converted, and once nothing past count_samples is needed the rest of
+// the line is never looked at.
+struct LineDecoder {
+    int schema_version = 0;
+    // Batch column for each field before the samples, -1 to skip it. The
+    // flags field feeds has_gps_column and clipping_column instead.
+    std::vector<int> field_columns;
+    int has_gps_column = -1;
+    int clipping_column = -1;
+    int samples_column = -1;
+    // Batch column for each sample_stats_schema column, -1 when not converted.
+    std::vector<int> stat_columns;
+    bool sample_stats = false;
+    bool verify_checksum = true;
+};
 
-    if (sum != checksum) {
-        throw std::runtime_error("Checksum failed");
-    }
+// verify_checksum only matters when samples and their statistics are
+// projected away; decoded samples are always checked against the checksum.
+LineDecoder make_line_decoder(int schema_version, const CaptureSchema2& schema, bool verify_checksum);
 
-    return std::map<std::string, std::any> {
-        {"cpu_time", computer_time},
-        {"gps_time", gps_time},
-        {"has_gps", has_gps},
-        {"clipping", clipping},
-        {"sample_rate", sample_rate},
-        {"latitude", latitude},
-        {"longitude", longitude},
-        {"elevation", elevation},
-        {"satellite_count", satellite_count},
-        {"speed", speed},
-        {"heading", heading},
-        {"count_samples", count_samples},
-        {"samples", tokens}
-    };
+// Decode one data line into the batch. Throws ParseError on a malformed line,
+// in which case the batch is left as it was.
+void parse_line_v2(std::string_view line, const LineDecoder& decoder, Batch& batch);
 
-}
+void parse_line_v3(std::string_view line, const LineDecoder& decoder, Batch& batch);
 
-#endif
\ No newline at end of file
+#endif
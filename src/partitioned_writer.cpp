@@ -0,0 +1,245 @@
+#include "partitioned_writer.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <format>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+
+namespace fs = std::filesystem;
+
+static uint64_t column_width(const ColumnSchema& column) {
+    switch (column.netcdf_type) {
+        case NC_DOUBLE:
+        case NC_UINT64:
+            return 8;
+        case NC_INT:
+            return 4;
+        case NC_BYTE:
+            return 1;
+        case NC_SHORT:
+        case NC_USHORT:
+            return 2;
+        default:
+            throw std::runtime_error(std::format("unsupported NetCDF type {} for column {}", column.netcdf_type, column.label));
+    }
+}
+
+PartitionedWriter::PartitionedWriter(const fs::path& output_path, const CaptureSchema2& schema,
+                                     const WriterOptions& options, const PartitionOptions& partition)
+    : output_path_(output_path), schema_(schema), options_(options), partition_(partition), pending_(schema) {
+
+    switch (partition_.interval) {
+        case PartitionInterval::None:
+            interval_seconds_ = 0;
+            break;
+        case PartitionInterval::Hourly:
+            interval_seconds_ = 3600;
+            break;
+        case PartitionInterval::Daily:
+            interval_seconds_ = 86400;
+            break;
+    }
+
+    for (size_t i = 0; i < schema_.columns.size(); i++) {
+        const ColumnSchema& column = schema_.columns[i];
+        uint64_t width = column_width(column);
+        bytes_per_row_ += column.label == "samples" ? width * samples_per_row : width;
+
+        if (column.label == "gps_time") {
+            gps_column_ = i;
+        } else if (column.label == "has_gps") {
+            has_gps_column_ = i;
+        }
+    }
+
+    if (interval_seconds_ && !gps_column_) {
+        throw std::runtime_error("time partitioning needs a gps_time column");
+    }
+}
+
+PartitionedWriter::~PartitionedWriter() {
+    for (auto& closing : closing_) {
+        try {
+            closing.get();
+        } catch (const std::exception& e) {
+            spdlog::error("{}", e.what());
+        }
+    }
+}
+
+uint64_t PartitionedWriter::partition_key(const BatchView& batch, size_t row) const {
+    if (!interval_seconds_) {
+        return 0;
+    }
+    return batch.column<uint64_t>(*gps_column_)[row] / interval_seconds_;
+}
+
+bool PartitionedWriter::has_fix(const BatchView& batch, size_t row) const {
+    if (gps_column_ && batch.column<uint64_t>(*gps_column_)[row] == 0) {
+        return false;
+    }
+    return !has_gps_column_ || batch.column<int8_t>(*has_gps_column_)[row] != 0;
+}
+
+// Copies rows [begin, begin + count) of a view to the end of an owned batch.
+static void copy_rows(const BatchView& from, size_t begin, size_t count, Batch& to) {
+    for (size_t i = 0; i < to.columns.size(); i++) {
+        std::visit([&](auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            // int16 columns hold the two dimensional samples block
+            const size_t width = std::is_same_v<T, int16_t> ? samples_per_row : 1;
+            std::span<const T> rows = from.column<T>(i).subspan(begin * width, count * width);
+            values.insert(values.end(), rows.begin(), rows.end());
+        }, to.columns[i]);
+    }
+    to.rows += count;
+}
+
+void PartitionedWriter::open(std::optional<uint64_t> key) {
+    std::string label;
+    if (partition_.interval != PartitionInterval::None && key) {
+        std::chrono::sys_seconds start{std::chrono::seconds(*key * interval_seconds_)};
+        label = partition_.interval == PartitionInterval::Hourly
+            ? std::format("{:%Y%m%dT%H}", start)
+            : std::format("{:%Y%m%d}", start);
+    }
+
+    sequence_ = !outputs_.empty() && label == current_label_ ? sequence_ + 1 : 0;
+
+    fs::path path = output_path_;
+    if (!label.empty() || partition_.rollover_bytes) {
+        fs::path stem = output_path_;
+        if (stem.extension() == ".nc") {
+            stem.replace_extension();
+        }
+
+        std::string name = stem.string();
+        if (!label.empty()) {
+            name += "." + label;
+        }
+        if (partition_.rollover_bytes) {
+            name += std::format(".{:04}", sequence_);
+        }
+        path = name + ".nc";
+    }
+
+    spdlog::debug("opening partition {}", path.string());
+    current_ = std::make_unique<Writer>(path, schema_, options_);
+    if (!label.empty()) {
+        current_->put_text_attribute("partition", label);
+    }
+
+    current_label_ = label;
+    current_key_ = key.value_or(0);
+    current_bytes_ = 0;
+    errors_at_open_ = parsing_errors_;
+    outputs_.push_back(path);
+}
+
+void PartitionedWriter::finish_current() {
+    if (!current_) {
+        return;
+    }
+
+    current_->set_parsing_errors(parsing_errors_ - errors_at_open_);
+
+    // netcdf-c calls are serialized inside Writer, but the close still overlaps
+    // with parsing the next rows.
+    closing_.push_back(std::async(std::launch::async, [writer = std::move(current_)]() {
+        writer->close();
+    }));
+}
+
+void PartitionedWriter::append(const BatchView& batch) {
+    if (current_ || !interval_seconds_) {
+        write(batch, 0);
+        return;
+    }
+
+    size_t first_fix = 0;
+    while (first_fix < batch.rows && !has_fix(batch, first_fix)) {
+        first_fix++;
+    }
+
+    if (first_fix == batch.rows) {
+        copy_rows(batch, 0, batch.rows, pending_);
+        if (pending_.rows < max_pending_rows) {
+            return;
+        }
+        spdlog::warn("no GPS fix in the first {} rows, writing them without a time label", pending_.rows);
+        open(std::nullopt);
+        write(pending_.view(), 0);
+        pending_.clear();
+        return;
+    }
+
+    open(partition_key(batch, first_fix));
+    if (pending_.rows > 0) {
+        write(pending_.view(), 0);
+        pending_.clear();
+    }
+    write(batch, 0);
+}
+
+void PartitionedWriter::write(const BatchView& batch, size_t begin) {
+    while (begin < batch.rows) {
+        if (!current_) {
+            open(partition_key(batch, begin));
+        }
+
+        size_t end = begin;
+        while (end < batch.rows) {
+            if (interval_seconds_ && has_fix(batch, end) && partition_key(batch, end) > current_key_) {
+                break;
+            }
+            if (partition_.rollover_bytes && current_bytes_ > 0 && current_bytes_ + bytes_per_row_ > partition_.rollover_bytes) {
+                break;
+            }
+            current_bytes_ += bytes_per_row_;
+            end++;
+        }
+
+        current_->append(batch, begin, end - begin);
+
+        if (end < batch.rows) {
+            finish_current();
+            // A rollover keeps the current label, including having none
+            std::optional<uint64_t> key;
+            if (interval_seconds_ && has_fix(batch, end)) {
+                key = std::max(partition_key(batch, end), current_key_);
+            } else if (!current_label_.empty()) {
+                key = current_key_;
+            }
+            open(key);
+        }
+
+        begin = end;
+    }
+}
+
+void PartitionedWriter::close() {
+    // Rows that never saw a fix go to a file without a time label. Scaffolds
+    // and empty inputs still produce output_path itself.
+    if (!current_ && pending_.rows > 0) {
+        open(std::nullopt);
+        write(pending_.view(), 0);
+        pending_.clear();
+    } else if (!current_ && outputs_.empty()) {
+        spdlog::debug("opening {}", output_path_.string());
+        current_ = std::make_unique<Writer>(output_path_, schema_, options_);
+        errors_at_open_ = parsing_errors_;
+        outputs_.push_back(output_path_);
+    }
+
+    finish_current();
+
+    std::vector<std::future<void>> closing = std::move(closing_);
+    closing_.clear();
+    for (auto& pending : closing) {
+        pending.get();
+    }
+}
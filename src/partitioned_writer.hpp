@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "parsing.hpp"
+#include "writer.hpp"
+
+enum class PartitionInterval {
+    None,
+    Hourly,
+    Daily
+};
+
+struct PartitionOptions {
+    PartitionInterval interval = PartitionInterval::None;
+    // Start a new file once the uncompressed data would exceed this, 0 to disable.
+    uint64_t rollover_bytes = 0;
+};
+
+// Spreads rows over a series of Writers, one per gps_time hour or day and/or
+// per size threshold. Every partition gets the same layout and metadata. A
+// finished partition is closed on its own thread while ingest carries on into
+// the next one.
+//
+// Partitions only move forward: rows whose gps_time steps back, or rows without
+// a GPS fix, stay in the current partition. Leading rows without a fix are held
+// back until the first fix names the first partition; if none arrives within
+// max_pending_rows they go to a file without a time label. Partition names
+// format gps_time as seconds since the Unix epoch.
+//
+// Without an interval or rollover size, or when no row has a fix, this writes
+// output_path exactly like a single Writer.
+class PartitionedWriter {
+public:
+    PartitionedWriter(const std::filesystem::path& output_path, const CaptureSchema2& schema,
+                      const WriterOptions& options, const PartitionOptions& partition);
+    ~PartitionedWriter();
+
+    PartitionedWriter(const PartitionedWriter&) = delete;
+    PartitionedWriter& operator=(const PartitionedWriter&) = delete;
+
+    void append(const BatchView& batch);
+
+    void append(const Batch& batch) {
+        append(batch.view());
+    }
+
+    void close();
+
+    // Total parsing errors so far; each partition records the errors seen
+    // while it was open.
+    void set_parsing_errors(uint64_t errors) {
+        parsing_errors_ = errors;
+    }
+
+    const std::vector<std::filesystem::path>& outputs() const {
+        return outputs_;
+    }
+
+    // An hour of rows at one row per second.
+    static constexpr size_t max_pending_rows = 3600;
+
+private:
+    uint64_t partition_key(const BatchView& batch, size_t row) const;
+    bool has_fix(const BatchView& batch, size_t row) const;
+    // Opens the partition for key, or one without a time label for nullopt.
+    void open(std::optional<uint64_t> key);
+    void write(const BatchView& batch, size_t begin);
+    void finish_current();
+
+    std::filesystem::path output_path_;
+    CaptureSchema2 schema_;
+    WriterOptions options_;
+    PartitionOptions partition_;
+    uint64_t interval_seconds_ = 0;
+    uint64_t bytes_per_row_ = 0;
+    std::optional<size_t> gps_column_;
+    std::optional<size_t> has_gps_column_;
+    Batch pending_;
+
+    std::unique_ptr<Writer> current_;
+    std::string current_label_;
+    uint64_t current_key_ = 0;
+    uint64_t current_bytes_ = 0;
+    size_t sequence_ = 0;
+    uint64_t parsing_errors_ = 0;
+    uint64_t errors_at_open_ = 0;
+
+    std::vector<std::future<void>> closing_;
+    std::vector<std::filesystem::path> outputs_;
+};
@@ -0,0 +1,277 @@
+#include "read_ahead.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef CSV2NC_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#ifdef CSV2NC_HAVE_IO_URING
+class UringBackend : public IoBackend {
+public:
+    explicit UringBackend(size_t depth) {
+        int status = io_uring_queue_init(static_cast<unsigned>(depth), &ring_, 0);
+        if (status < 0) {
+            throw std::runtime_error(std::format("io_uring_queue_init failed: {}", std::strerror(-status)));
+        }
+    }
+
+    ~UringBackend() override {
+        io_uring_queue_exit(&ring_);
+    }
+
+    void submit(int fd, char* buffer, size_t length, uint64_t offset, size_t tag) override {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        if (!sqe) {
+            throw std::runtime_error("io_uring submission queue is full");
+        }
+        io_uring_prep_read(sqe, fd, buffer, static_cast<unsigned>(length), offset);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(tag));
+
+        int status = io_uring_submit(&ring_);
+        if (status < 0) {
+            throw std::runtime_error(std::format("io_uring_submit failed: {}", std::strerror(-status)));
+        }
+    }
+
+    Completion wait() override {
+        io_uring_cqe* cqe;
+        int status = io_uring_wait_cqe(&ring_, &cqe);
+        if (status < 0) {
+            throw std::runtime_error(std::format("io_uring_wait_cqe failed: {}", std::strerror(-status)));
+        }
+
+        Completion completion{
+            .tag = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe)),
+            .result = cqe->res
+        };
+        io_uring_cqe_seen(&ring_, cqe);
+        return completion;
+    }
+
+    const char* name() const override {
+        return "io_uring";
+    }
+
+private:
+    io_uring ring_;
+};
+#endif
+
+// Fallback backend: a handful of threads issuing blocking preads.
+class PreadBackend : public IoBackend {
+public:
+    explicit PreadBackend(size_t threads) {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+            threads_.emplace_back([this]() { run(); });
+        }
+    }
+
+    ~PreadBackend() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        requests_ready_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void submit(int fd, char* buffer, size_t length, uint64_t offset, size_t tag) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            requests_.push_back({fd, buffer, length, offset, tag});
+        }
+        requests_ready_.notify_one();
+    }
+
+    Completion wait() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        completions_ready_.wait(lock, [this]() { return !completions_.empty(); });
+        Completion completion = completions_.front();
+        completions_.pop_front();
+        return completion;
+    }
+
+    const char* name() const override {
+        return "pread";
+    }
+
+private:
+    struct Request {
+        int fd;
+        char* buffer;
+        size_t length;
+        uint64_t offset;
+        size_t tag;
+    };
+
+    void run() {
+        for (;;) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                requests_ready_.wait(lock, [this]() { return stopping_ || !requests_.empty(); });
+                if (requests_.empty()) {
+                    return;
+                }
+                request = requests_.front();
+                requests_.pop_front();
+            }
+
+            ssize_t result = pread(request.fd, request.buffer, request.length, static_cast<off_t>(request.offset));
+            if (result < 0) {
+                result = -errno;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                completions_.push_back({request.tag, result});
+            }
+            completions_ready_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable requests_ready_;
+    std::condition_variable completions_ready_;
+    std::deque<Request> requests_;
+    std::deque<Completion> completions_;
+    bool stopping_ = false;
+};
+
+std::unique_ptr<IoBackend> make_io_backend(size_t depth, bool use_io_uring) {
+#ifdef CSV2NC_HAVE_IO_URING
+    if (use_io_uring) {
+        try {
+            return std::make_unique<UringBackend>(depth);
+        } catch (const std::exception& e) {
+            spdlog::debug("{}, falling back to pread", e.what());
+        }
+    }
+#else
+    (void) use_io_uring;
+#endif
+    return std::make_unique<PreadBackend>(depth);
+}
+
+ReadAhead::ReadAhead(const fs::path& path, const ReadAheadOptions& options)
+    : path_(path), options_(options) {
+
+    options_.depth = std::max<size_t>(options_.depth, 1);
+    options_.block_size = std::max<size_t>(options_.block_size, 4096);
+
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::format("failed to open {}: {}", path.string(), std::strerror(errno)));
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        ::close(fd_);
+        throw std::runtime_error(std::format("failed to stat {}: {}", path.string(), std::strerror(errno)));
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    backend_ = make_io_backend(options_.depth, options_.use_io_uring);
+    spdlog::trace("reading {} with {} blocks of {} bytes in flight via {}", path.string(), options_.depth, options_.block_size, backend_->name());
+
+    slots_.resize(options_.depth);
+    for (size_t i = 0; i < slots_.size() && submit_offset_ < size_; i++) {
+        slots_[i].buffer = std::make_unique<char[]>(options_.block_size);
+        submit(i);
+    }
+}
+
+ReadAhead::~ReadAhead() {
+    // Reads still in flight target our buffers, so let them land first.
+    while (in_flight_ > 0) {
+        try {
+            complete(backend_->wait());
+        } catch (const std::exception&) {
+            break;
+        }
+    }
+    backend_.reset();
+    ::close(fd_);
+}
+
+void ReadAhead::submit(size_t slot) {
+    Slot& s = slots_[slot];
+    s.offset = submit_offset_;
+    s.length = static_cast<size_t>(std::min<uint64_t>(options_.block_size, size_ - submit_offset_));
+    s.pending = true;
+    s.ready = false;
+    submit_offset_ += s.length;
+    in_flight_++;
+    backend_->submit(fd_, s.buffer.get(), s.length, s.offset, slot);
+}
+
+void ReadAhead::complete(const IoBackend::Completion& completion) {
+    Slot& s = slots_[completion.tag];
+    in_flight_--;
+    s.pending = false;
+    s.ready = true;
+    s.result = completion.result;
+}
+
+std::string_view ReadAhead::next() {
+    // The block handed out last time is done with, reuse its slot.
+    if (release_pending_) {
+        release_pending_ = false;
+        size_t released = (next_block_ - 1) % slots_.size();
+        if (submit_offset_ < size_) {
+            submit(released);
+        }
+    }
+
+    size_t slot = next_block_ % slots_.size();
+    Slot& s = slots_[slot];
+    if (!s.pending && !s.ready) {
+        return {};
+    }
+
+    while (!s.ready) {
+        complete(backend_->wait());
+    }
+
+    if (s.result < 0) {
+        throw std::runtime_error(std::format("failed to read {}: {}", path_.string(), std::strerror(static_cast<int>(-s.result))));
+    }
+
+    // Finish short reads synchronously; they are rare on regular files.
+    size_t filled = static_cast<size_t>(s.result);
+    while (filled < s.length) {
+        ssize_t result = pread(fd_, s.buffer.get() + filled, s.length - filled, static_cast<off_t>(s.offset + filled));
+        if (result < 0) {
+            throw std::runtime_error(std::format("failed to read {}: {}", path_.string(), std::strerror(errno)));
+        }
+        if (result == 0) {
+            break;
+        }
+        filled += static_cast<size_t>(result);
+    }
+
+    s.ready = false;
+    next_block_++;
+    release_pending_ = true;
+    return {s.buffer.get(), filled};
+}
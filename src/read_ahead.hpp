@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+struct ReadAheadOptions {
+    size_t block_size = 4 << 20;
+    size_t depth = 4;
+    bool use_io_uring = true;
+};
+
+// Something that can run positional reads asynchronously. Completions are
+// reported by tag, in whatever order the reads finish.
+class IoBackend {
+public:
+    struct Completion {
+        size_t tag;
+        ssize_t result;
+    };
+
+    virtual ~IoBackend() = default;
+    virtual void submit(int fd, char* buffer, size_t length, uint64_t offset, size_t tag) = 0;
+    virtual Completion wait() = 0;
+    virtual const char* name() const = 0;
+};
+
+// Prefers io_uring and falls back to a pread thread pool when io_uring is not
+// compiled in or the kernel refuses to set up a ring.
+std::unique_ptr<IoBackend> make_io_backend(size_t depth, bool use_io_uring);
+
+// Reads a file front to back in fixed size blocks while keeping up to `depth`
+// reads in flight ahead of the consumer.
+class ReadAhead {
+public:
+    ReadAhead(const std::filesystem::path& path, const ReadAheadOptions& options);
+    ~ReadAhead();
+
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+
+    // Returns the next block of the file, empty once the whole file has been
+    // returned. The view stays valid until the following call.
+    std::string_view next();
+
+    // True once every block of the file has been queued, which is when the
+    // caller can start priming the next file.
+    bool fully_submitted() const {
+        return submit_offset_ >= size_;
+    }
+
+    uint64_t size() const {
+        return size_;
+    }
+
+    const std::filesystem::path& path() const {
+        return path_;
+    }
+
+private:
+    struct Slot {
+        std::unique_ptr<char[]> buffer;
+        uint64_t offset = 0;
+        size_t length = 0;
+        ssize_t result = 0;
+        bool pending = false;
+        bool ready = false;
+    };
+
+    void submit(size_t slot);
+    void complete(const IoBackend::Completion& completion);
+
+    std::filesystem::path path_;
+    ReadAheadOptions options_;
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    std::unique_ptr<IoBackend> backend_;
+    std::vector<Slot> slots_;
+    uint64_t submit_offset_ = 0;
+    size_t next_block_ = 0;
+    size_t in_flight_ = 0;
+    bool release_pending_ = false;
+};
@@ -0,0 +1,119 @@
+#include "sample_stats.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static void accumulate_scalar(SampleStats& stats, const int16_t* samples, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const int16_t value = samples[i];
+        stats.min = std::min(stats.min, value);
+        stats.max = std::max(stats.max, value);
+        stats.sum += value;
+        stats.sum_squares += static_cast<uint64_t>(int64_t{value} * value);
+        stats.clipped += value == sample_rail_low || value == sample_rail_high;
+        stats.saturated += value <= sample_rail_low + sample_saturation_margin || value >= sample_rail_high - sample_saturation_margin;
+    }
+}
+
+#ifdef __SSE2__
+// Narrow lane accumulators are flushed after this many samples, well before
+// the 16 bit counters or 32 bit sums could overflow.
+static constexpr size_t sse2_block = 2048;
+
+static int64_t horizontal_sum_epi32(__m128i v) {
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+    return int64_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+}
+
+static uint64_t horizontal_sum_epi64(__m128i v) {
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+    return lanes[0] + lanes[1];
+}
+
+static uint32_t horizontal_sum_epu16(__m128i v) {
+    alignas(16) uint16_t lanes[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+    uint32_t total = 0;
+    for (uint16_t lane : lanes) {
+        total += lane;
+    }
+    return total;
+}
+
+static int16_t horizontal_reduce_epi16(__m128i v, bool minimum) {
+    alignas(16) int16_t lanes[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+    return minimum ? *std::min_element(lanes, lanes + 8) : *std::max_element(lanes, lanes + 8);
+}
+#endif
+
+SampleStats compute_sample_stats(std::span<const int16_t> samples) {
+    SampleStats stats;
+    stats.min = std::numeric_limits<int16_t>::max();
+    stats.max = std::numeric_limits<int16_t>::min();
+
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rail_low = _mm_set1_epi16(sample_rail_low);
+    const __m128i rail_high = _mm_set1_epi16(sample_rail_high);
+    const __m128i saturated_below = _mm_set1_epi16(sample_rail_low + sample_saturation_margin + 1);
+    const __m128i saturated_above = _mm_set1_epi16(sample_rail_high - sample_saturation_margin - 1);
+
+    __m128i min = _mm_set1_epi16(stats.min);
+    __m128i max = _mm_set1_epi16(stats.max);
+
+    while (i + 8 <= samples.size()) {
+        const size_t block_end = i + std::min(sse2_block, (samples.size() - i) & ~size_t{7});
+
+        __m128i sum = zero;
+        __m128i sum_squares = zero;
+        __m128i clipped = zero;
+        __m128i saturated = zero;
+
+        for (; i < block_end; i += 8) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples.data() + i));
+
+            min = _mm_min_epi16(min, v);
+            max = _mm_max_epi16(max, v);
+
+            // Pairwise products land in 32 bit lanes. Squares are widened to
+            // 64 bits right away, as two of them can exceed INT32_MAX.
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(v, ones));
+            const __m128i squares = _mm_madd_epi16(v, v);
+            sum_squares = _mm_add_epi64(sum_squares, _mm_unpacklo_epi32(squares, zero));
+            sum_squares = _mm_add_epi64(sum_squares, _mm_unpackhi_epi32(squares, zero));
+
+            // Comparison masks are -1 per matching lane
+            const __m128i on_rail = _mm_or_si128(_mm_cmpeq_epi16(v, rail_low), _mm_cmpeq_epi16(v, rail_high));
+            const __m128i near_rail = _mm_or_si128(_mm_cmplt_epi16(v, saturated_below), _mm_cmpgt_epi16(v, saturated_above));
+            clipped = _mm_sub_epi16(clipped, on_rail);
+            saturated = _mm_sub_epi16(saturated, near_rail);
+        }
+
+        stats.sum += horizontal_sum_epi32(sum);
+        stats.sum_squares += horizontal_sum_epi64(sum_squares);
+        stats.clipped += horizontal_sum_epu16(clipped);
+        stats.saturated += horizontal_sum_epu16(saturated);
+    }
+
+    stats.min = horizontal_reduce_epi16(min, true);
+    stats.max = horizontal_reduce_epi16(max, false);
+#endif
+
+    accumulate_scalar(stats, samples.data() + i, samples.size() - i);
+
+    if (samples.empty()) {
+        stats.min = 0;
+        stats.max = 0;
+    }
+    return stats;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// ADC rails of the 10 bit digitizer, matching the samples variable's
+// valid_min and valid_max.
+constexpr int16_t sample_rail_low = 0;
+constexpr int16_t sample_rail_high = 1023;
+
+// Samples this close to a rail count as saturated.
+constexpr int16_t sample_saturation_margin = 8;
+
+// Reductions over one row of samples.
+//
+// clipped counts samples sitting on a rail (0 or 1023). saturated counts
+// samples within sample_saturation_margin of a rail, so it includes the
+// clipped ones.
+struct SampleStats {
+    int16_t min = 0;
+    int16_t max = 0;
+    int64_t sum = 0;
+    uint64_t sum_squares = 0;
+    uint32_t clipped = 0;
+    uint32_t saturated = 0;
+};
+
+// Computes all reductions in one pass, eight samples at a time with SSE2 where
+// available.
+SampleStats compute_sample_stats(std::span<const int16_t> samples);
@@ -0,0 +1,142 @@
+#include "utils.hpp"
+#include "hash.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <cctype>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+InputScan scan_input(const std::filesystem::path& file_path, const ReadAheadOptions& read_options) {
+    InputScan scan;
+    Xxh64 hash;
+    ReadAhead reader(file_path, read_options);
+
+    // A line that is just "\r" is empty to the reader too. Its '\r' can end a
+    // block, in which case the next block decides.
+    bool line_start = true;
+    bool lone_cr = false;
+    for (std::string_view block; !(block = reader.next()).empty();) {
+        const char* p = block.data();
+        const char* end = p + block.size();
+        if (lone_cr && *p != '\n') {
+            scan.data_lines++;
+        }
+        lone_cr = false;
+
+        while (p < end) {
+            if (line_start && *p == '\r') {
+                if (p + 1 == end) {
+                    lone_cr = true;
+                } else if (p[1] != '\n') {
+                    scan.data_lines++;
+                }
+            } else if (line_start && *p != '#' && *p != '\n') {
+                scan.data_lines++;
+            }
+
+            const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!newline) {
+                line_start = false;
+                break;
+            }
+            scan.lines++;
+            line_start = true;
+            p = newline + 1;
+        }
+
+        scan.bytes += block.size();
+        hash.update(block.data(), block.size());
+    }
+
+    scan.hash = hash.digest();
+    return scan;
+}
+
+std::vector<std::filesystem::path> read_file_list(const std::filesystem::path& list_path) {
+    std::filesystem::path input_directory = list_path;
+    input_directory.remove_filename();
+
+    std::vector<std::filesystem::path> files;
+    std::ifstream file_stream(list_path);
+    for (std::string line; std::getline(file_stream, line);) {
+        if (line.empty()) {
+            continue;
+        }
+        files.push_back(input_directory / line);
+    }
+    return files;
+}
+
+int get_schema_version(std::istream& file) {
+    file.clear();
+    file.seekg(0, std::ios::beg);
+
+    std::map<std::string, std::string> metadata = parse_metadata(file);
+
+    for (const auto& [key, value] : metadata) {
+        spdlog::debug("Metadata: {} = {}", key, value);
+    }
+
+    if (metadata.empty()) {
+        return 1;
+    } else if (!metadata.empty() && metadata.find("version") == metadata.end()) {
+        return 2;
+    } else if (metadata.find("version") != metadata.end()) {
+        // Values keep any trailing whitespace
+        std::string_view value = metadata["version"];
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
+            value.remove_suffix(1);
+        }
+        int version;
+        if (!parse_field(value, version)) {
+            throw std::runtime_error(std::format("invalid schema version: \"{}\"", metadata["version"]));
+        }
+        return version;
+    }
+
+    for (const auto& [key, value] : metadata) {
+        spdlog::debug("Metadata: {} = {}", key, value);
+    }
+    
+    throw std::runtime_error("Unknown schema version");
+
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::format("failed to open {}: {}", path.string(), std::strerror(errno)));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error(std::format("failed to stat {}: {}", path.string(), std::strerror(errno)));
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data_ == MAP_FAILED) {
+            data_ = nullptr;
+            ::close(fd);
+            throw std::runtime_error(std::format("failed to map {}: {}", path.string(), std::strerror(errno)));
+        }
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+}
@@ -0,0 +1,206 @@
+#include "validate.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "utils.hpp"
+
+static const CaptureSchema2& full_schema(int schema_version) {
+    return schema_version == 2 ? v2_schema : v3_schema;
+}
+
+static size_t column_index(const CaptureSchema2& schema, const std::string& label) {
+    for (size_t i = 0; i < schema.columns.size(); i++) {
+        if (schema.columns[i].label == label) {
+            return i;
+        }
+    }
+    throw std::runtime_error(std::format("schema has no {} column", label));
+}
+
+LineChecker::LineChecker(int schema_version)
+    : decoder_(make_line_decoder(schema_version, full_schema(schema_version), true)),
+      scratch_(full_schema(schema_version)),
+      gps_time_column_(column_index(full_schema(schema_version), "gps_time")),
+      has_gps_column_(column_index(full_schema(schema_version), "has_gps")) {
+    scratch_.reserve(1);
+}
+
+RowError LineChecker::check(std::string_view line, uint64_t& gps_time, bool& has_fix) {
+    scratch_.clear();
+
+    try {
+        if (decoder_.schema_version == 2) {
+            parse_line_v2(line, decoder_, scratch_);
+        } else {
+            parse_line_v3(line, decoder_, scratch_);
+        }
+    } catch (const ParseError& e) {
+        return e.reason;
+    }
+
+    gps_time = scratch_.column<uint64_t>(gps_time_column_).front();
+    has_fix = gps_time != 0 && scratch_.column<int8_t>(has_gps_column_).front() != 0;
+    return RowError::None;
+}
+
+BlockResult validate_block(std::string_view block, int schema_version) {
+    auto start = std::chrono::steady_clock::now();
+    BlockResult result;
+    LineChecker checker(schema_version);
+
+    while (!block.empty()) {
+        size_t newline = block.find('\n');
+        std::string_view line = block.substr(0, newline);
+        block.remove_prefix(newline == std::string_view::npos ? block.size() : newline + 1);
+        result.lines++;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        result.rows++;
+
+        uint64_t gps_time = 0;
+        bool has_fix = false;
+        RowError error = checker.check(line, gps_time, has_fix);
+        if (error != RowError::None) {
+            result.bad_rows[static_cast<size_t>(error)]++;
+            if (result.first_bad_line == 0) {
+                result.first_bad_line = result.lines;
+                result.first_bad_reason = error;
+            }
+            continue;
+        }
+
+        result.valid_rows++;
+        if (!has_fix) {
+            result.no_fix_rows++;
+            continue;
+        }
+        result.gps_time_min = std::min(result.gps_time_min, gps_time);
+        result.gps_time_max = std::max(result.gps_time_max, gps_time);
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::vector<FileReport> validate_files(const std::vector<std::filesystem::path>& files,
+                                       int schema_version,
+                                       size_t block_size,
+                                       unsigned threads) {
+    struct Task {
+        size_t file;
+        size_t block;
+        size_t begin;
+        size_t end;
+    };
+
+    std::vector<FileReport> reports(files.size());
+    std::vector<std::unique_ptr<MappedFile>> mappings(files.size());
+    std::vector<std::vector<BlockResult>> block_results(files.size());
+    std::vector<std::atomic<size_t>> blocks_remaining(files.size());
+    std::vector<Task> tasks;
+
+    for (size_t i = 0; i < files.size(); i++) {
+        reports[i].path = files[i];
+        reports[i].schema_version = schema_version;
+
+        try {
+            if (reports[i].schema_version == 0) {
+                std::ifstream file(files[i]);
+                if (!file) {
+                    throw std::runtime_error(std::format("failed to open {}", files[i].string()));
+                }
+                reports[i].schema_version = get_schema_version(file);
+            }
+            if (reports[i].schema_version != 2 && reports[i].schema_version != 3) {
+                throw std::runtime_error(std::format("unsupported schema version {}", reports[i].schema_version));
+            }
+
+            mappings[i] = std::make_unique<MappedFile>(files[i]);
+        } catch (const std::exception& e) {
+            reports[i].error = e.what();
+            continue;
+        }
+
+        std::string_view data = mappings[i]->view();
+        size_t begin = 0;
+        size_t block = 0;
+        while (begin < data.size()) {
+            size_t end = std::min(begin + block_size, data.size());
+            size_t newline = data.find('\n', end == 0 ? 0 : end - 1);
+            end = newline == std::string_view::npos ? data.size() : newline + 1;
+            tasks.push_back({i, block++, begin, end});
+            begin = end;
+        }
+
+        block_results[i].resize(block);
+        blocks_remaining[i] = block;
+    }
+
+    std::atomic<size_t> next_task{0};
+    std::mutex report_mutex;
+
+    auto worker = [&]() {
+        for (size_t t; (t = next_task.fetch_add(1)) < tasks.size();) {
+            const Task& task = tasks[t];
+            std::string_view data = mappings[task.file]->view().substr(task.begin, task.end - task.begin);
+            block_results[task.file][task.block] = validate_block(data, reports[task.file].schema_version);
+
+            // The last block of a file releases its mapping.
+            if (blocks_remaining[task.file].fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(report_mutex);
+                mappings[task.file].reset();
+                spdlog::debug("validated {}", files[task.file].string());
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < std::max(1u, threads); i++) {
+        pool.emplace_back(worker);
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    // Merge blocks in order so line numbers stay absolute.
+    for (size_t i = 0; i < files.size(); i++) {
+        FileReport& report = reports[i];
+        size_t line_offset = 0;
+
+        for (const BlockResult& block : block_results[i]) {
+            report.rows += block.rows;
+            report.valid_rows += block.valid_rows;
+            report.no_fix_rows += block.no_fix_rows;
+            for (size_t r = 0; r < row_error_count; r++) {
+                report.bad_rows[r] += block.bad_rows[r];
+            }
+            if (report.first_bad_line == 0 && block.first_bad_line != 0) {
+                report.first_bad_line = line_offset + block.first_bad_line;
+                report.first_bad_reason = block.first_bad_reason;
+            }
+            report.gps_time_min = std::min(report.gps_time_min, block.gps_time_min);
+            report.gps_time_max = std::max(report.gps_time_max, block.gps_time_max);
+            report.seconds += block.seconds;
+            line_offset += block.lines;
+        }
+    }
+
+    return reports;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch.hpp"
+#include "parsing.hpp"
+
+// Validation decodes rows with the converter's own parser but never touches
+// netcdf-c, so files and blocks can be spread across every core.
+
+constexpr size_t row_error_count = static_cast<size_t>(RowError::Count);
+
+constexpr std::array<const char*, row_error_count> row_error_names = {
+    "ok",
+    "missing_field",
+    "invalid_number",
+    "sample_count",
+    "checksum"
+};
+
+// Checks v2/v3 data lines by decoding them against the full schema into a
+// scratch batch that is emptied after every line, so a line passes exactly
+// when conversion would keep it.
+class LineChecker {
+public:
+    explicit LineChecker(int schema_version);
+
+    // On success gps_time holds the row's timestamp and has_fix whether it
+    // has a GPS fix, i.e. the G flag and a non-zero gps_time.
+    RowError check(std::string_view line, uint64_t& gps_time, bool& has_fix);
+
+private:
+    LineDecoder decoder_;
+    Batch scratch_;
+    size_t gps_time_column_;
+    size_t has_gps_column_;
+};
+
+struct FileReport {
+    std::filesystem::path path;
+    int schema_version = 0;
+    size_t rows = 0;
+    size_t valid_rows = 0;
+    // Valid rows without a GPS fix, which are left out of the gps_time range
+    size_t no_fix_rows = 0;
+    std::array<size_t, row_error_count> bad_rows{};
+    size_t first_bad_line = 0;
+    RowError first_bad_reason = RowError::None;
+    uint64_t gps_time_min = std::numeric_limits<uint64_t>::max();
+    uint64_t gps_time_max = 0;
+    double seconds = 0;
+    std::string error;
+
+    size_t total_bad_rows() const {
+        return rows - valid_rows;
+    }
+
+    bool has_gps_times() const {
+        return valid_rows > no_fix_rows;
+    }
+};
+
+struct BlockResult {
+    size_t lines = 0;
+    size_t rows = 0;
+    size_t valid_rows = 0;
+    size_t no_fix_rows = 0;
+    std::array<size_t, row_error_count> bad_rows{};
+    size_t first_bad_line = 0;
+    RowError first_bad_reason = RowError::None;
+    uint64_t gps_time_min = std::numeric_limits<uint64_t>::max();
+    uint64_t gps_time_max = 0;
+    double seconds = 0;
+};
+
+BlockResult validate_block(std::string_view block, int schema_version);
+
+// Validates every file, splitting each one into line-aligned blocks that are
+// handed out to a pool of worker threads. A schema_version of 0 detects it per
+// file. Files that cannot be read or have an unsupported schema get an error in
+// their report and do not stop the others.
+std::vector<FileReport> validate_files(const std::vector<std::filesystem::path>& files,
+                                       int schema_version,
+                                       size_t block_size,
+                                       unsigned threads);
@@ -0,0 +1,284 @@
+#include "writer.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+static void check_nc(int status, const char* what) {
+    if (status != NC_NOERR) {
+        throw std::runtime_error(std::format("NetCDF error in {} (code {}): {}", what, status, nc_strerror(status)));
+    }
+}
+
+static std::mutex& netcdf_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+// A batch of rows holding the default fill value of every column.
+static Batch make_fill_batch(const CaptureSchema2& schema, size_t rows) {
+    Batch batch(schema);
+    for (auto& column : batch.columns) {
+        std::visit([rows](auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            if constexpr (std::is_same_v<T, double>) {
+                values.assign(rows, NC_FILL_DOUBLE);
+            } else if constexpr (std::is_same_v<T, uint64_t>) {
+                values.assign(rows, NC_FILL_UINT64);
+            } else if constexpr (std::is_same_v<T, int32_t>) {
+                values.assign(rows, NC_FILL_INT);
+            } else if constexpr (std::is_same_v<T, int8_t>) {
+                values.assign(rows, NC_FILL_BYTE);
+            } else if constexpr (std::is_same_v<T, int16_t>) {
+                values.assign(rows * samples_per_row, NC_FILL_SHORT);
+            }
+        }, column);
+    }
+    batch.rows = rows;
+    return batch;
+}
+
+static std::optional<std::string> read_text_attribute(int ncid, const char* name) {
+    size_t length;
+    if (nc_inq_attlen(ncid, NC_GLOBAL, name, &length) != NC_NOERR) {
+        return std::nullopt;
+    }
+
+    std::string value(length, '\0');
+    if (nc_get_att_text(ncid, NC_GLOBAL, name, value.data()) != NC_NOERR) {
+        return std::nullopt;
+    }
+
+    // "complete" is written with its terminating NUL
+    while (!value.empty() && value.back() == '\0') {
+        value.pop_back();
+    }
+    return value;
+}
+
+bool output_is_current(const fs::path& output_path, const std::string& source_hash, const std::string& conversion_options) {
+    if (!fs::exists(output_path)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(netcdf_mutex());
+
+    int ncid;
+    if (nc_open(output_path.c_str(), NC_NOWRITE, &ncid) != NC_NOERR) {
+        spdlog::debug("cannot open existing output {}", output_path.string());
+        return false;
+    }
+
+    const std::pair<const char*, std::string> expected[] = {
+        {"complete", "yes"},
+        {"converter_version", CSV2NC_VERSION},
+        {"conversion_options", conversion_options},
+        {"source_hash", source_hash},
+    };
+
+    bool current = true;
+    for (const auto& [name, value] : expected) {
+        auto found = read_text_attribute(ncid, name);
+        if (found != value) {
+            spdlog::debug("existing output {} differs in {}: \"{}\" != \"{}\"", output_path.string(), name, found.value_or(""), value);
+            current = false;
+            break;
+        }
+    }
+
+    nc_close(ncid);
+    return current;
+}
+
+Writer::Writer(const fs::path& output_path, const CaptureSchema2& schema, const WriterOptions& options)
+    : schema_(schema), output_path_(output_path), temp_path_(output_path.string() + ".tmp") {
+
+    std::lock_guard<std::mutex> lock(netcdf_mutex());
+
+    check_nc(nc_create(temp_path_.c_str(), NC_NETCDF4, &ncid_), "nc_create");
+
+    int format;
+    nc_inq_format(ncid_, &format);
+    spdlog::debug("NetCDF format: {}", format);
+
+    define(options);
+
+    check_nc(nc_enddef(ncid_), "nc_enddef");
+}
+
+Writer::~Writer() {
+    if (ncid_ >= 0) {
+        spdlog::warn("closing unfinished NetCDF file: {}", temp_path_.string());
+        std::lock_guard<std::mutex> lock(netcdf_mutex());
+        nc_close(ncid_);
+    }
+}
+
+void Writer::define(const WriterOptions& options) {
+    if (options.schema_version > 1) {
+        check_nc(nc_put_att(ncid_, NC_GLOBAL, "original_schema_version", NC_BYTE, 1, &options.schema_version), "original_schema_version");
+
+        for (auto const& [key, val] : options.metadata) {
+            std::string lower_key = key;
+            std::transform(lower_key.begin(), lower_key.end(), lower_key.begin(), ::tolower);
+            check_nc(nc_put_att(ncid_, NC_GLOBAL, lower_key.c_str(), NC_CHAR, val.length(), val.c_str()), "metadata");
+
+            spdlog::debug("Added metadata: {} = {}", lower_key, val);
+        }
+    }
+
+    if (!options.source_files.empty()) {
+        std::vector<const char*> text;
+        text.reserve(options.source_files.size());
+        for (const auto& source_file : options.source_files) {
+            text.push_back(source_file.c_str());
+        }
+        check_nc(nc_put_att(ncid_, NC_GLOBAL, "source_files", NC_STRING, text.size(), text.data()), "source_files");
+    }
+
+    check_nc(nc_put_att_text(ncid_, NC_GLOBAL, "converter_version", std::strlen(CSV2NC_VERSION), CSV2NC_VERSION), "converter_version");
+    check_nc(nc_put_att_text(ncid_, NC_GLOBAL, "conversion_options", options.conversion_options.length(), options.conversion_options.c_str()), "conversion_options");
+
+    if (!options.source_hash.empty()) {
+        check_nc(nc_put_att_text(ncid_, NC_GLOBAL, "source_hash", options.source_hash.length(), options.source_hash.c_str()), "source_hash");
+    }
+
+    if (!options.source_hashes.empty()) {
+        std::vector<const char*> text;
+        text.reserve(options.source_hashes.size());
+        for (const auto& hash : options.source_hashes) {
+            text.push_back(hash.c_str());
+        }
+        check_nc(nc_put_att(ncid_, NC_GLOBAL, "source_hashes", NC_STRING, text.size(), text.data()), "source_hashes");
+    }
+
+    // With the row count known up front the time dimension can be fixed, which
+    // avoids chunk indexing for the unlimited dimension. Every row gets written,
+    // so pre-filling is wasted work.
+    time_length_ = options.time_length;
+    if (time_length_) {
+        int old_mode;
+        check_nc(nc_set_fill(ncid_, NC_NOFILL, &old_mode), "nc_set_fill");
+    }
+
+    // Define dimensions
+    int time_dimid, sample_dimid;
+    check_nc(nc_def_dim(ncid_, "time", time_length_ ? time_length_ : NC_UNLIMITED, &time_dimid), "time dimension");
+    check_nc(nc_def_dim(ncid_, "sample", samples_per_row, &sample_dimid), "sample dimension");
+
+    for (const ColumnSchema& column : schema_.columns) {
+        int varid;
+
+        if (column.label == "samples") {
+            int dims[2] = {time_dimid, sample_dimid};
+            check_nc(nc_def_var(ncid_, "samples", NC_SHORT, 2, dims, &varid), "samples");
+            short valid_range[2] = {0, 1023};
+            check_nc(nc_put_att(ncid_, varid, "valid_min", NC_SHORT, 1, &valid_range[0]), "valid_min");
+            check_nc(nc_put_att(ncid_, varid, "valid_max", NC_SHORT, 1, &valid_range[1]), "valid_max");
+        } else {
+            check_nc(nc_def_var(ncid_, column.label.c_str(), column.netcdf_type, 1, &time_dimid, &varid), column.label.c_str());
+
+            if (!column.unit.empty()) {
+                nc_put_att(ncid_, varid, "units", NC_CHAR, column.unit.length(), column.unit.c_str());
+            }
+        }
+
+        if (options.deflate) {
+            check_nc(nc_def_var_deflate(ncid_, varid, 0, 1, options.deflate), "nc_def_var_deflate");
+        } else if (options.contiguous && time_length_) {
+            check_nc(nc_def_var_chunking(ncid_, varid, NC_CONTIGUOUS, nullptr), "nc_def_var_chunking");
+        }
+
+        varids_.push_back(varid);
+        spdlog::debug("created variable \"{}\" with type \"{}\"", column.label, column.netcdf_type);
+    }
+}
+
+void Writer::append(const BatchView& batch, size_t begin, size_t count) {
+    if (batch.columns.size() != schema_.columns.size()) {
+        throw std::runtime_error(std::format("batch has {} columns, schema has {}", batch.columns.size(), schema_.columns.size()));
+    }
+
+    if (begin + count > batch.rows) {
+        throw std::runtime_error(std::format("rows {}..{} are outside a batch of {} rows", begin, begin + count, batch.rows));
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    if (time_length_ && rows_ + count > time_length_) {
+        throw std::runtime_error(std::format("{} rows do not fit the fixed time dimension of {}", rows_ + count, time_length_));
+    }
+
+    std::lock_guard<std::mutex> lock(netcdf_mutex());
+
+    for (size_t i = 0; i < batch.columns.size(); i++) {
+        std::visit([&](const auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            const bool is_samples = std::is_same_v<T, int16_t>;
+            const size_t width = is_samples ? samples_per_row : 1;
+
+            if (values.size() != batch.rows * width) {
+                throw std::runtime_error(std::format("column {} has {} values for {} rows", schema_.columns[i].label, values.size(), batch.rows));
+            }
+
+            size_t startp[2] = {rows_, 0};
+            size_t countp[2] = {count, samples_per_row};
+            check_nc(nc_put_vara(ncid_, varids_[i], startp, countp, values.data() + begin * width), schema_.columns[i].label.c_str());
+        }, batch.columns[i]);
+    }
+
+    rows_ += count;
+}
+
+void Writer::put_text_attribute(const std::string& name, const std::string& value) {
+    std::lock_guard<std::mutex> lock(netcdf_mutex());
+    check_nc(nc_put_att_text(ncid_, NC_GLOBAL, name.c_str(), value.length(), value.c_str()), name.c_str());
+}
+
+void Writer::close() {
+    if (ncid_ < 0) {
+        return;
+    }
+
+    // Rows lost to parse errors leave a tail that was never written. Without
+    // fill mode it holds garbage, so give it fill values and record where the
+    // real data ends.
+    const size_t valid_rows = rows_;
+    if (time_length_ && rows_ < time_length_) {
+        spdlog::warn("{} of {} rows were not written, filling the rest of the time dimension", time_length_ - rows_, time_length_);
+        const size_t fill_rows = std::min<size_t>(time_length_ - rows_, 256);
+        const Batch fill = make_fill_batch(schema_, fill_rows);
+        const BatchView fill_view = fill.view();
+        while (rows_ < time_length_) {
+            append(fill_view, 0, std::min(fill_rows, time_length_ - rows_));
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(netcdf_mutex());
+
+    if (time_length_) {
+        unsigned long long valid = valid_rows;
+        check_nc(nc_put_att(ncid_, NC_GLOBAL, "valid_rows", NC_UINT64, 1, &valid), "valid_rows");
+    }
+
+    long long errors = static_cast<long long>(parsing_errors_);
+    check_nc(nc_put_att(ncid_, NC_GLOBAL, "parsing_errors", NC_INT64, 1, &errors), "parsing_errors");
+    check_nc(nc_put_att(ncid_, NC_GLOBAL, "complete", NC_CHAR, 4, "yes"), "complete");
+
+    check_nc(nc_close(ncid_), "nc_close");
+    ncid_ = -1;
+    lock.unlock();
+
+    spdlog::info("moving temporary file to final location... {}->{}", temp_path_.string(), output_path_.string());
+    fs::rename(temp_path_, output_path_);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "parsing.hpp"
+
+#ifndef CSV2NC_VERSION
+#define CSV2NC_VERSION "unknown"
+#endif
+
+struct WriterOptions {
+    int deflate = 0;
+    uint8_t schema_version = 0;
+    std::map<std::string, std::string> metadata;
+    std::vector<std::string> source_files;
+
+    // Recorded so a later run can tell whether this output is still current.
+    std::vector<std::string> source_hashes;
+    std::string source_hash;
+    std::string conversion_options;
+
+    // Fixed length of the time dimension, 0 for unlimited. A fixed length
+    // turns off fill values; rows that never arrive are filled in by close().
+    size_t time_length = 0;
+    // Store uncompressed variables contiguously, needs a fixed time_length.
+    bool contiguous = false;
+};
+
+// True when output_path is a finished conversion of inputs with the given
+// combined hash, produced by this converter version with the same options.
+bool output_is_current(const std::filesystem::path& output_path, const std::string& source_hash, const std::string& conversion_options);
+
+// Writes batches into a NetCDF file laid out after a CaptureSchema2. Data goes
+// to "<output>.tmp" and is only moved into place by close(), so an interrupted
+// run never leaves a file that looks complete.
+//
+// netcdf-c is not thread safe, so every Writer serializes its library calls on
+// one process wide lock. Different Writers may still be used from different
+// threads, e.g. to close one file while another is being filled.
+class Writer {
+public:
+    Writer(const std::filesystem::path& output_path, const CaptureSchema2& schema, const WriterOptions& options);
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void append(const BatchView& batch) {
+        append(batch, 0, batch.rows);
+    }
+
+    void append(const Batch& batch) {
+        append(batch.view());
+    }
+
+    void append(const Batch& batch, size_t begin, size_t count) {
+        append(batch.view(), begin, count);
+    }
+
+    // Appends rows [begin, begin + count) of the batch.
+    void append(const BatchView& batch, size_t begin, size_t count);
+    void close();
+
+    void put_text_attribute(const std::string& name, const std::string& value);
+
+    void set_parsing_errors(uint64_t errors) {
+        parsing_errors_ = errors;
+    }
+
+    size_t rows() const {
+        return rows_;
+    }
+
+private:
+    void define(const WriterOptions& options);
+
+    CaptureSchema2 schema_;
+    std::filesystem::path output_path_;
+    std::filesystem::path temp_path_;
+    int ncid_ = -1;
+    std::vector<int> varids_;
+    size_t rows_ = 0;
+    size_t time_length_ = 0;
+    uint64_t parsing_errors_ = 0;
+};